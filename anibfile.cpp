@@ -0,0 +1,360 @@
+#include "anibfile.h"
+#include "curve.h"
+
+#include <string.h>
+#include <float.h>
+
+// the control points are copied in and out as arrays of floats
+static_assert(sizeof(Point) == 2 * sizeof(float), "Point must be two packed floats");
+static_assert(sizeof(AnibHeader) == 24 && sizeof(AnibCurveEntry) == 32,
+	"the .anib structures must not be padded");
+
+// the curve table entry of version 1, without the checksum
+struct AnibCurveEntryVersion1
+{
+	int iType;
+	unsigned int uiFirstPoint;
+	unsigned int uiPointCount;
+	float fMaxX;
+	unsigned int uiWrap;
+};
+
+// the curve table entry of version 2, without the y range
+struct AnibCurveEntryVersion2
+{
+	int iType;
+	unsigned int uiFirstPoint;
+	unsigned int uiPointCount;
+	float fMaxX;
+	unsigned int uiWrap;
+	unsigned int uiChecksum;
+};
+
+AnibFile::AnibFile() :
+	m_pfFile(NULL),
+	m_lPointsOffset(0)
+{
+	memset(&m_ahHeader, 0, sizeof(m_ahHeader));
+}
+
+AnibFile::~AnibFile()
+{
+	close();
+}
+
+bool AnibFile::isAnibFileName(const char* szFileName)
+{
+	size_t iLength = strlen(szFileName);
+	return iLength >= 5 && !stricmp(szFileName + iLength - 5, ".anib");
+}
+
+unsigned int AnibFile::checksum(const unsigned char* pbyData, size_t iBytes)
+{
+	// FNV-1a
+	unsigned int uiHash = 2166136261u;
+	for (size_t i = 0; i < iBytes; ++i) {
+		uiHash ^= pbyData[i];
+		uiHash *= 16777619u;
+	}
+	return uiHash;
+}
+
+bool AnibFile::save(const char* szFileName, float fEndTime,
+	const Curve* const* ppCurves, const int* piCurveTypes, int iCurveCount)
+{
+	unsigned int uiPointCount = 0;
+	for (int i = 0; i < iCurveCount; ++i)
+		uiPointCount += ppCurves[i]->controlPointCount();
+
+	size_t iTableBytes = iCurveCount * sizeof(AnibCurveEntry);
+	size_t iBytes = sizeof(AnibHeader) + iTableBytes + uiPointCount * sizeof(Point);
+	std::vector<unsigned char> ucvData(iBytes);
+
+	AnibCurveEntry* paceTable = (AnibCurveEntry*)&ucvData[sizeof(AnibHeader)];
+	Point* pptPoints = (Point*)&ucvData[sizeof(AnibHeader) + iTableBytes];
+	unsigned int uiFirstPoint = 0;
+	for (int i = 0; i < iCurveCount; ++i) {
+		const std::vector<Point>& ptvCtrlPts = ppCurves[i]->controlPoints();
+		paceTable[i].iType = piCurveTypes[i];
+		paceTable[i].uiFirstPoint = uiFirstPoint;
+		paceTable[i].uiPointCount = (unsigned int)ptvCtrlPts.size();
+		paceTable[i].fMaxX = ppCurves[i]->maxX();
+		paceTable[i].uiWrap = ppCurves[i]->wrap() ? 1 : 0;
+		paceTable[i].fMinY = FLT_MAX;
+		paceTable[i].fMaxY = -FLT_MAX;
+		for (size_t iPt = 0; iPt < ptvCtrlPts.size(); ++iPt) {
+			if (ptvCtrlPts[iPt].y < paceTable[i].fMinY)
+				paceTable[i].fMinY = ptvCtrlPts[iPt].y;
+			if (ptvCtrlPts[iPt].y > paceTable[i].fMaxY)
+				paceTable[i].fMaxY = ptvCtrlPts[iPt].y;
+		}
+		if (!ptvCtrlPts.empty())
+			memcpy(pptPoints + uiFirstPoint, &ptvCtrlPts[0], ptvCtrlPts.size() * sizeof(Point));
+		paceTable[i].uiChecksum = checksum((const unsigned char*)(pptPoints + uiFirstPoint),
+			ptvCtrlPts.size() * sizeof(Point));
+		uiFirstPoint += (unsigned int)ptvCtrlPts.size();
+	}
+
+	AnibHeader* pahHeader = (AnibHeader*)&ucvData[0];
+	memcpy(pahHeader->szMagic, "ANIB", 4);
+	pahHeader->uiVersion = k_uiVersion;
+	pahHeader->uiCurveCount = iCurveCount;
+	pahHeader->uiPointCount = uiPointCount;
+	pahHeader->fEndTime = fEndTime;
+	pahHeader->uiChecksum = checksum((const unsigned char*)paceTable, iTableBytes);
+
+	FILE* pfFile = fopen(szFileName, "wb");
+	if (!pfFile)
+		return false;
+	setvbuf(pfFile, NULL, _IONBF, 0);
+	bool bWritten = fwrite(&ucvData[0], iBytes, 1, pfFile) == 1;
+	fclose(pfFile);
+	return bWritten;
+}
+
+bool AnibFile::open(const char* szFileName)
+{
+	close();
+
+	m_pfFile = fopen(szFileName, "rb");
+	if (!m_pfFile)
+		return false;
+
+	fseek(m_pfFile, 0, SEEK_END);
+	long lFileBytes = ftell(m_pfFile);
+	fseek(m_pfFile, 0, SEEK_SET);
+
+	if (lFileBytes < (long)sizeof(AnibHeader) ||
+		fread(&m_ahHeader, sizeof(AnibHeader), 1, m_pfFile) != 1 ||
+		memcmp(m_ahHeader.szMagic, "ANIB", 4) != 0 ||
+		m_ahHeader.fEndTime <= 0.0f) {
+		close();
+		return false;
+	}
+
+	bool bOpened = false;
+	if (m_ahHeader.uiVersion == 1) {
+		bOpened = openVersion1(lFileBytes);
+	}
+	else if (m_ahHeader.uiVersion == 2) {
+		bOpened = openVersion2(lFileBytes);
+	}
+	else if (m_ahHeader.uiVersion == k_uiVersion) {
+		size_t iTableBytes = (size_t)m_ahHeader.uiCurveCount * sizeof(AnibCurveEntry);
+		m_lPointsOffset = (long)(sizeof(AnibHeader) + iTableBytes);
+		if ((size_t)lFileBytes == m_lPointsOffset + (size_t)m_ahHeader.uiPointCount * sizeof(Point)) {
+			m_acevCurves.resize(m_ahHeader.uiCurveCount);
+			bOpened = m_acevCurves.empty() ||
+				(fread(&m_acevCurves[0], iTableBytes, 1, m_pfFile) == 1 &&
+				checksum((const unsigned char*)&m_acevCurves[0], iTableBytes) == m_ahHeader.uiChecksum);
+		}
+	}
+
+	// every curve's points must lie inside the point array
+	for (int i = 0; bOpened && i < curveCount(); ++i) {
+		if (m_acevCurves[i].uiFirstPoint > m_ahHeader.uiPointCount ||
+			m_acevCurves[i].uiPointCount > m_ahHeader.uiPointCount - m_acevCurves[i].uiFirstPoint)
+			bOpened = false;
+	}
+
+	// the evaluators need at least one control point, so a curve without
+	// any is left to be reported as damaged while the others still load
+	m_bvRejected.assign(curveCount(), false);
+	for (int i = 0; bOpened && i < curveCount(); ++i) {
+		if (m_acevCurves[i].uiPointCount < 1)
+			m_bvRejected[i] = true;
+	}
+
+	if (!bOpened)
+		close();
+	return bOpened;
+}
+
+bool AnibFile::openVersion1(long lFileBytes)
+{
+	// no per curve checksums, so everything is read and checked now
+	size_t iTableBytes = (size_t)m_ahHeader.uiCurveCount * sizeof(AnibCurveEntryVersion1);
+	size_t iPointBytes = (size_t)m_ahHeader.uiPointCount * sizeof(Point);
+	if ((size_t)lFileBytes != sizeof(AnibHeader) + iTableBytes + iPointBytes)
+		return false;
+
+	std::vector<unsigned char> ucvData(iTableBytes + iPointBytes);
+	if (!ucvData.empty() && fread(&ucvData[0], ucvData.size(), 1, m_pfFile) != 1)
+		return false;
+	if (checksum(ucvData.empty() ? NULL : &ucvData[0], ucvData.size()) != m_ahHeader.uiChecksum)
+		return false;
+
+	const AnibCurveEntryVersion1* pacevTable = (const AnibCurveEntryVersion1*)(ucvData.empty() ? NULL : &ucvData[0]);
+	m_acevCurves.resize(m_ahHeader.uiCurveCount);
+	for (int i = 0; i < curveCount(); ++i) {
+		m_acevCurves[i].iType = pacevTable[i].iType;
+		m_acevCurves[i].uiFirstPoint = pacevTable[i].uiFirstPoint;
+		m_acevCurves[i].uiPointCount = pacevTable[i].uiPointCount;
+		m_acevCurves[i].fMaxX = pacevTable[i].fMaxX;
+		m_acevCurves[i].uiWrap = pacevTable[i].uiWrap;
+		m_acevCurves[i].uiChecksum = 0;
+		m_acevCurves[i].fMinY = FLT_MAX;
+		m_acevCurves[i].fMaxY = -FLT_MAX;
+	}
+
+	const Point* pptPoints = (const Point*)(ucvData.empty() ? NULL : &ucvData[iTableBytes]);
+	m_ptvPoints.assign(pptPoints, pptPoints + m_ahHeader.uiPointCount);
+
+	fclose(m_pfFile);
+	m_pfFile = NULL;
+	return true;
+}
+
+bool AnibFile::openVersion2(long lFileBytes)
+{
+	// laid out like the current version, with shorter table entries
+	size_t iTableBytes = (size_t)m_ahHeader.uiCurveCount * sizeof(AnibCurveEntryVersion2);
+	m_lPointsOffset = (long)(sizeof(AnibHeader) + iTableBytes);
+	if ((size_t)lFileBytes != m_lPointsOffset + (size_t)m_ahHeader.uiPointCount * sizeof(Point))
+		return false;
+
+	std::vector<AnibCurveEntryVersion2> acevTable(m_ahHeader.uiCurveCount);
+	if (!acevTable.empty() &&
+		(fread(&acevTable[0], iTableBytes, 1, m_pfFile) != 1 ||
+		checksum((const unsigned char*)&acevTable[0], iTableBytes) != m_ahHeader.uiChecksum))
+		return false;
+
+	m_acevCurves.resize(acevTable.size());
+	for (int i = 0; i < curveCount(); ++i) {
+		m_acevCurves[i].iType = acevTable[i].iType;
+		m_acevCurves[i].uiFirstPoint = acevTable[i].uiFirstPoint;
+		m_acevCurves[i].uiPointCount = acevTable[i].uiPointCount;
+		m_acevCurves[i].fMaxX = acevTable[i].fMaxX;
+		m_acevCurves[i].uiWrap = acevTable[i].uiWrap;
+		m_acevCurves[i].uiChecksum = acevTable[i].uiChecksum;
+		m_acevCurves[i].fMinY = FLT_MAX;
+		m_acevCurves[i].fMaxY = -FLT_MAX;
+	}
+	return true;
+}
+
+void AnibFile::close()
+{
+	std::lock_guard<std::mutex> lock(m_mtxFile);
+	if (m_pfFile)
+		fclose(m_pfFile);
+	m_pfFile = NULL;
+	memset(&m_ahHeader, 0, sizeof(m_ahHeader));
+	m_acevCurves.clear();
+	m_bvRejected.clear();
+	m_ptvPoints.clear();
+}
+
+bool AnibFile::readPoints(int iCurve, std::vector<Point>& ptvPoints)
+{
+	if (m_bvRejected[iCurve])
+		return false;
+
+	const AnibCurveEntry& aceCurve = m_acevCurves[iCurve];
+	ptvPoints.resize(aceCurve.uiPointCount);
+
+	if (m_ahHeader.uiVersion == 1) {
+		memcpy(&ptvPoints[0], &m_ptvPoints[aceCurve.uiFirstPoint], ptvPoints.size() * sizeof(Point));
+		return true;
+	}
+
+	size_t iBytes = ptvPoints.size() * sizeof(Point);
+	{
+		std::lock_guard<std::mutex> lock(m_mtxFile);
+		if (!m_pfFile ||
+			fseek(m_pfFile, m_lPointsOffset + (long)(aceCurve.uiFirstPoint * sizeof(Point)), SEEK_SET) != 0 ||
+			fread(&ptvPoints[0], iBytes, 1, m_pfFile) != 1)
+			return false;
+	}
+	return checksum((const unsigned char*)&ptvPoints[0], iBytes) == aceCurve.uiChecksum;
+}
+
+AnibPrefetcher::AnibPrefetcher() :
+	m_bStopReader(false)
+{
+}
+
+AnibPrefetcher::~AnibPrefetcher()
+{
+	close();
+}
+
+bool AnibPrefetcher::open(const char* szFileName)
+{
+	close();
+
+	if (!m_afFile.open(szFileName))
+		return false;
+
+	m_bvPending.assign(m_afFile.curveCount(), true);
+	m_bvReadAhead.assign(m_afFile.curveCount(), false);
+	m_ptvvReadAhead.resize(m_afFile.curveCount());
+
+	m_bStopReader = false;
+	m_thdReader = std::thread(&AnibPrefetcher::readerLoop, this);
+	return true;
+}
+
+void AnibPrefetcher::close()
+{
+	if (m_thdReader.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_mtxCurves);
+			m_bStopReader = true;
+		}
+		m_thdReader.join();
+	}
+
+	m_afFile.close();
+	m_bvPending.clear();
+	m_bvReadAhead.clear();
+	m_ptvvReadAhead.clear();
+}
+
+bool AnibPrefetcher::pending(int iCurve) const
+{
+	std::lock_guard<std::mutex> lock(m_mtxCurves);
+	return iCurve < (int)m_bvPending.size() && m_bvPending[iCurve];
+}
+
+bool AnibPrefetcher::take(int iCurve, std::vector<Point>& ptvPoints)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxCurves);
+		if (!m_bvPending[iCurve])
+			return false;
+		m_bvPending[iCurve] = false;
+		if (m_bvReadAhead[iCurve]) {
+			ptvPoints.swap(m_ptvvReadAhead[iCurve]);
+			std::vector<Point>().swap(m_ptvvReadAhead[iCurve]);
+			return true;
+		}
+	}
+
+	// not read yet, so read it now instead of waiting for the reader
+	return m_afFile.readPoints(iCurve, ptvPoints);
+}
+
+void AnibPrefetcher::readerLoop()
+{
+	std::vector<Point> ptvPoints;
+	for (int iCurve = 0; iCurve < m_afFile.curveCount(); ++iCurve) {
+		{
+			std::lock_guard<std::mutex> lock(m_mtxCurves);
+			if (m_bStopReader)
+				return;
+			if (!m_bvPending[iCurve])
+				continue;
+		}
+
+		// damaged curves are left for take() to report
+		if (!m_afFile.readPoints(iCurve, ptvPoints))
+			continue;
+
+		std::lock_guard<std::mutex> lock(m_mtxCurves);
+		if (m_bvPending[iCurve]) {
+			m_ptvvReadAhead[iCurve].swap(ptvPoints);
+			m_bvReadAhead[iCurve] = true;
+		}
+	}
+}
@@ -0,0 +1,134 @@
+#ifndef ANIBFILE_H_INCLUDED
+#define ANIBFILE_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <stdio.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+
+#include "point.h"
+
+class Curve;
+
+// Binary animation script (.anib), the compact counterpart of the text
+// .ani format. The file is
+//
+//   AnibHeader
+//   an AnibCurveEntry for each curve
+//   the control points of all curves, one contiguous run of (x, y)
+//   floats per curve
+//
+// in the byte order of the machine that wrote it. The header checksum
+// covers the curve table and each curve's checksum its points, so the
+// table can be read on its own and the points of a curve when they are
+// needed. Version 1 files had no per curve checksums and a header
+// checksum over everything after the header; they are still read, but
+// all at once. Version 2 files had no y range in the curve table, so
+// none of their curves is known to be constant.
+struct AnibHeader
+{
+	char szMagic[4];	// "ANIB"
+	unsigned int uiVersion;
+	unsigned int uiChecksum;
+	unsigned int uiCurveCount;
+	unsigned int uiPointCount;
+	float fEndTime;
+};
+
+struct AnibCurveEntry
+{
+	int iType;
+	unsigned int uiFirstPoint;
+	unsigned int uiPointCount;
+	float fMaxX;
+	unsigned int uiWrap;
+	unsigned int uiChecksum;
+	// the lowest and highest y of the points, so that a constant curve
+	// can be evaluated without reading them; an empty range if unknown
+	float fMinY;
+	float fMaxY;
+};
+
+class AnibFile
+{
+public:
+	static const unsigned int k_uiVersion = 3;
+
+	AnibFile();
+	~AnibFile();
+
+	// true if the name ends with .anib
+	static bool isAnibFileName(const char* szFileName);
+
+	// writes the file with a single write
+	static bool save(const char* szFileName, float fEndTime,
+		const Curve* const* ppCurves, const int* piCurveTypes, int iCurveCount);
+
+	// reads and checks the header and the curve table. The points stay
+	// in the file, which is kept open until close(). A curve entry
+	// without points is rejected: the file still opens, but reading the
+	// curve's points fails as if they were damaged.
+	bool open(const char* szFileName);
+	void close();
+
+	// nothing is open after a failed open
+	float endTime() const { return m_ahHeader.fEndTime; }
+	int curveCount() const { return (int)m_acevCurves.size(); }
+	const AnibCurveEntry& curve(int iCurve) const { return m_acevCurves[iCurve]; }
+
+	// reads the control points of one curve and checks them against the
+	// table; false for a damaged or rejected curve. May be called from
+	// any thread.
+	bool readPoints(int iCurve, std::vector<Point>& ptvPoints);
+
+protected:
+	AnibHeader m_ahHeader;
+	std::vector<AnibCurveEntry> m_acevCurves;
+	// the entries open() rejected
+	std::vector<bool> m_bvRejected;
+	FILE* m_pfFile;
+	long m_lPointsOffset;
+	std::mutex m_mtxFile;
+	// the points of a version 1 file, which are read with the table
+	std::vector<Point> m_ptvPoints;
+
+	bool openVersion1(long lFileBytes);
+	bool openVersion2(long lFileBytes);
+	static unsigned int checksum(const unsigned char* pbyData, size_t iBytes);
+};
+
+// Hands out the curves of an .anib file one by one as they are needed,
+// while a background thread reads ahead through the rest, so opening a
+// script only costs reading its curve table.
+class AnibPrefetcher
+{
+public:
+	AnibPrefetcher();
+	~AnibPrefetcher();
+
+	bool open(const char* szFileName);
+	// stops the read ahead and closes the file
+	void close();
+
+	const AnibFile& file() const { return m_afFile; }
+	// true until the curve has been taken
+	bool pending(int iCurve) const;
+	// the points of a curve, read ahead or read now. Every curve is
+	// taken once; false if its points are damaged.
+	bool take(int iCurve, std::vector<Point>& ptvPoints);
+
+protected:
+	AnibFile m_afFile;
+	std::thread m_thdReader;
+	mutable std::mutex m_mtxCurves;
+	bool m_bStopReader;
+	std::vector<bool> m_bvPending;
+	std::vector<bool> m_bvReadAhead;
+	std::vector<std::vector<Point> > m_ptvvReadAhead;
+
+	void readerLoop();
+};
+
+#endif // ANIBFILE_H_INCLUDED
@@ -0,0 +1,90 @@
+#include "animationbake.h"
+#include "profiler.h"
+
+#include <math.h>
+#include <string.h>
+
+AnimationBake::AnimationBake() :
+	m_iFrameCount(0),
+	m_iChannelCount(0),
+	m_iFps(0),
+	m_fEndTime(0.0f)
+{
+}
+
+void AnimationBake::bake(const Curve* const* ppCurves, const int iCurveCount, 
+						 const float fEndTime, const int iFps)
+{
+	PROFILE_SCOPE("bake");
+
+	m_iChannelCount = iCurveCount;
+	m_iFps = iFps;
+	m_fEndTime = fEndTime;
+	m_iFrameCount = (int)(fEndTime * iFps + 0.5f) + 1;
+
+	m_pcrvvCurves.assign(ppCurves, ppCurves + iCurveCount);
+	m_ivRevisions.resize(iCurveCount);
+	m_fvTable.resize(m_iFrameCount * m_iChannelCount);
+
+	// the table is frame by frame, which is the order evaluateMany writes
+	for (int iChannel = 0; iChannel < m_iChannelCount; ++iChannel)
+		m_ivRevisions[iChannel] = ppCurves[iChannel]->revision();
+	if (!m_fvTable.empty())
+		Curve::evaluateMany(ppCurves, iCurveCount, 0.0f, 1.0f / iFps, m_iFrameCount, 
+			&m_fvTable[0]);
+}
+
+bool AnimationBake::upToDate(const Curve* const* ppCurves, const int iCurveCount, 
+							 const float fEndTime, const int iFps) const
+{
+	if (m_iFrameCount == 0 || iCurveCount != m_iChannelCount || 
+		iFps != m_iFps || fEndTime != m_fEndTime)
+		return false;
+
+	for (int iChannel = 0; iChannel < m_iChannelCount; ++iChannel) {
+		if (ppCurves[iChannel] != m_pcrvvCurves[iChannel] ||
+			ppCurves[iChannel]->revision() != m_ivRevisions[iChannel])
+			return false;
+	}
+
+	return true;
+}
+
+void AnimationBake::clear()
+{
+	m_fvTable.clear();
+	m_pcrvvCurves.clear();
+	m_ivRevisions.clear();
+	m_iFrameCount = 0;
+	m_iChannelCount = 0;
+}
+
+void AnimationBake::values(const float t, float* pfValues) const
+{
+	if (m_iFrameCount == 0)
+		return;
+
+	float fFrame = t * m_iFps;
+	if (fFrame < 0.0f)
+		fFrame = 0.0f;
+	if (fFrame > (float)(m_iFrameCount - 1))
+		fFrame = (float)(m_iFrameCount - 1);
+
+	int iFrame = (int)floorf(fFrame);
+	float fBlend = fFrame - iFrame;
+
+	// playback steps a whole frame at a time, so this is the usual case
+	if (fBlend < 0.001f || iFrame + 1 >= m_iFrameCount) {
+		memcpy(pfValues, frame(iFrame), m_iChannelCount * sizeof(float));
+		return;
+	}
+	if (fBlend > 0.999f) {
+		memcpy(pfValues, frame(iFrame + 1), m_iChannelCount * sizeof(float));
+		return;
+	}
+
+	const float* pfRow0 = frame(iFrame);
+	const float* pfRow1 = frame(iFrame + 1);
+	for (int iChannel = 0; iChannel < m_iChannelCount; ++iChannel)
+		pfValues[iChannel] = pfRow0[iChannel] + (pfRow1[iChannel] - pfRow0[iChannel]) * fBlend;
+}
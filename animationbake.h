@@ -0,0 +1,48 @@
+#ifndef ANIMATIONBAKE_H_INCLUDED
+#define ANIMATIONBAKE_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+
+#include "curve.h"
+
+// All the animated curves resampled once per frame into one table. The
+// table is laid out frame by frame, so playback reads one contiguous row
+// of control values per frame instead of evaluating every curve.
+class AnimationBake
+{
+public:
+	AnimationBake();
+
+	// samples the curves at iFps frames per second from 0 to fEndTime
+	void bake(const Curve* const* ppCurves, const int iCurveCount, 
+		const float fEndTime, const int iFps);
+	// true if the table was baked from exactly these curves, with the same
+	// timing, and none of the curves has been edited since
+	bool upToDate(const Curve* const* ppCurves, const int iCurveCount, 
+		const float fEndTime, const int iFps) const;
+	void clear();
+
+	int frameCount() const { return m_iFrameCount; }
+	int channelCount() const { return m_iChannelCount; }
+	int fps() const { return m_iFps; }
+	// the row of control values for a frame
+	const float* frame(const int iFrame) const { 
+		return &m_fvTable[iFrame * m_iChannelCount]; 
+	}
+	// copies the control values at time t into pfValues; t is expected to
+	// fall on a frame, otherwise the two nearest frames are blended
+	void values(const float t, float* pfValues) const;
+
+protected:
+	std::vector<float> m_fvTable;
+	std::vector<const Curve*> m_pcrvvCurves;
+	std::vector<int> m_ivRevisions;
+	int m_iFrameCount;
+	int m_iChannelCount;
+	int m_iFps;
+	float m_fEndTime;
+};
+
+#endif // ANIMATIONBAKE_H_INCLUDED
@@ -0,0 +1,70 @@
+#include "animationevaluator.h"
+
+AnimationEvaluator::AnimationEvaluator()
+{
+}
+
+void AnimationEvaluator::update(const Curve* const* ppCurves, const int iCurveCount)
+{
+	m_ptvvChannels.resize(iCurveCount);
+	m_pcrvvCurves.resize(iCurveCount, NULL);
+	m_ivRevisions.resize(iCurveCount);
+
+	for (int iChannel = 0; iChannel < iCurveCount; ++iChannel) {
+		const Curve* pcrvCurve = ppCurves[iChannel];
+		if (pcrvCurve == m_pcrvvCurves[iChannel] && 
+			pcrvCurve->revision() == m_ivRevisions[iChannel])
+			continue;
+
+		// the points are copied into the storage the channel already has
+		const std::vector<Point>& ptvPts = pcrvCurve->evaluatedPoints();
+		m_ptvvChannels[iChannel].assign(ptvPts.begin(), ptvPts.end());
+		m_pcrvvCurves[iChannel] = pcrvCurve;
+		m_ivRevisions[iChannel] = pcrvCurve->revision();
+	}
+}
+
+bool AnimationEvaluator::upToDate(const Curve* const* ppCurves, const int iCurveCount) const
+{
+	if (iCurveCount != channelCount())
+		return false;
+
+	for (int iChannel = 0; iChannel < iCurveCount; ++iChannel) {
+		if (ppCurves[iChannel] != m_pcrvvCurves[iChannel] ||
+			ppCurves[iChannel]->revision() != m_ivRevisions[iChannel])
+			return false;
+	}
+
+	return true;
+}
+
+void AnimationEvaluator::clear()
+{
+	m_ptvvChannels.clear();
+	m_pcrvvCurves.clear();
+	m_ivRevisions.clear();
+}
+
+void AnimationEvaluator::eval(const float t, AnimationState& asState) const
+{
+	asState.fTime = t;
+	asState.fvValues.resize(channelCount());
+	if (!asState.fvValues.empty())
+		eval(t, &asState.fvValues[0]);
+}
+
+AnimationState AnimationEvaluator::eval(const float t) const
+{
+	AnimationState asState;
+	eval(t, asState);
+	return asState;
+}
+
+void AnimationEvaluator::eval(const float t, float* pfValues) const
+{
+	for (int iChannel = 0; iChannel < channelCount(); ++iChannel) {
+		const std::vector<Point>& ptvPts = m_ptvvChannels[iChannel];
+		pfValues[iChannel] = Curve::evaluatePointsAt(ptvPts.empty() ? NULL : &ptvPts[0],
+			ptvPts.size(), t);
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef ANIMATIONEVALUATOR_H_INCLUDED
+#define ANIMATIONEVALUATOR_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+
+#include "curve.h"
+
+// The value of every animated control at one time
+struct AnimationState
+{
+	float fTime;
+	// one value per channel, in the order of the curves
+	std::vector<float> fvValues;
+};
+
+// Evaluates all the animated controls at a time straight from the curves,
+// without going through the user interface. update copies the evaluated
+// points out of the curves; after that eval only reads the copies, so any
+// number of threads can call it at once, and none of them touches a curve
+// or a widget.
+class AnimationEvaluator
+{
+public:
+	AnimationEvaluator();
+
+	// takes the points of the curves that were edited since the last
+	// update. Must run on the thread that edits the curves, and not while
+	// another thread is in eval.
+	void update(const Curve* const* ppCurves, const int iCurveCount);
+	// true if none of these curves has been edited since update
+	bool upToDate(const Curve* const* ppCurves, const int iCurveCount) const;
+	void clear();
+
+	int channelCount() const { return m_ptvvChannels.size(); }
+	void eval(const float t, AnimationState& asState) const;
+	AnimationState eval(const float t) const;
+	// writes the channel values at t to pfValues, channelCount of them
+	void eval(const float t, float* pfValues) const;
+
+protected:
+	// the evaluated points of each curve, and the curve and revision they
+	// were copied from
+	std::vector<std::vector<Point> > m_ptvvChannels;
+	std::vector<const Curve*> m_pcrvvCurves;
+	std::vector<int> m_ivRevisions;
+};
+
+#endif // ANIMATIONEVALUATOR_H_INCLUDED
@@ -0,0 +1,500 @@
+#include "batchrender.h"
+#include "framewriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif // WIN32
+
+#ifdef USE_OSMESA
+#include <GL/osmesa.h>
+#elif defined(WIN32)
+#include <GL/gl.h>
+
+// framebuffer objects are not in the OpenGL 1.1 headers
+#ifndef GL_FRAMEBUFFER_EXT
+#define GL_FRAMEBUFFER_EXT 0x8D40
+#define GL_RENDERBUFFER_EXT 0x8D41
+#define GL_COLOR_ATTACHMENT0_EXT 0x8CE0
+#define GL_DEPTH_ATTACHMENT_EXT 0x8D00
+#define GL_FRAMEBUFFER_COMPLETE_EXT 0x8CD5
+#endif
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+
+typedef void (APIENTRY * GenFramebuffersProc)(GLsizei n, GLuint* framebuffers);
+typedef void (APIENTRY * DeleteFramebuffersProc)(GLsizei n, const GLuint* framebuffers);
+typedef void (APIENTRY * BindFramebufferProc)(GLenum target, GLuint framebuffer);
+typedef GLenum (APIENTRY * CheckFramebufferStatusProc)(GLenum target);
+typedef void (APIENTRY * GenRenderbuffersProc)(GLsizei n, GLuint* renderbuffers);
+typedef void (APIENTRY * DeleteRenderbuffersProc)(GLsizei n, const GLuint* renderbuffers);
+typedef void (APIENTRY * BindRenderbufferProc)(GLenum target, GLuint renderbuffer);
+typedef void (APIENTRY * RenderbufferStorageProc)(GLenum target, GLenum internalformat, 
+	GLsizei width, GLsizei height);
+typedef void (APIENTRY * FramebufferRenderbufferProc)(GLenum target, GLenum attachment, 
+	GLenum renderbuffertarget, GLuint renderbuffer);
+
+static GenFramebuffersProc s_pfnGenFramebuffers = NULL;
+static DeleteFramebuffersProc s_pfnDeleteFramebuffers = NULL;
+static BindFramebufferProc s_pfnBindFramebuffer = NULL;
+static CheckFramebufferStatusProc s_pfnCheckFramebufferStatus = NULL;
+static GenRenderbuffersProc s_pfnGenRenderbuffers = NULL;
+static DeleteRenderbuffersProc s_pfnDeleteRenderbuffers = NULL;
+static BindRenderbufferProc s_pfnBindRenderbuffer = NULL;
+static RenderbufferStorageProc s_pfnRenderbufferStorage = NULL;
+static FramebufferRenderbufferProc s_pfnFramebufferRenderbuffer = NULL;
+
+static const char* s_szOffscreenWindowClass = "AnimatorOffscreen";
+#endif // USE_OSMESA
+
+static void printBatchUsage()
+{
+	fprintf(stderr, "usage: -batch script.ani [-out prefix] [-fps n] "
+		"[-start t] [-end t] [-size width height] [-jobs n] "
+		"[-format bmp|qoi|y4m|rgb]\n");
+	fprintf(stderr, "the frames are rendered offscreen; only when no offscreen "
+		"context can be made is the model's window shown to render into\n");
+}
+
+BatchOptions::BatchOptions() :
+	iFps(30),
+	fStartTime(-1.0f),
+	fEndTime(-1.0f),
+	iWidth(640),
+	iHeight(480),
+	iJobs(1),
+	strFormat("bmp"),
+	iFirstFrame(-1),
+	iLastFrame(-1)
+{
+}
+
+bool BatchOptions::requested(int argc, char** argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-batch") == 0)
+			return true;
+	}
+	return false;
+}
+
+bool BatchOptions::parse(int argc, char** argv)
+{
+	strProgramName = argv[0];
+
+	for (int i = 1; i < argc; ++i) {
+		const char* szArg = argv[i];
+		int iValues = (strcmp(szArg, "-size") == 0 || strcmp(szArg, "-frames") == 0) ? 2 : 1;
+		if (i + iValues >= argc) {
+			fprintf(stderr, "ERROR: missing value after %s\n", szArg);
+			printBatchUsage();
+			return false;
+		}
+
+		if (strcmp(szArg, "-batch") == 0)
+			strScriptFileName = argv[i + 1];
+		else if (strcmp(szArg, "-out") == 0)
+			strOutputBaseName = argv[i + 1];
+		else if (strcmp(szArg, "-fps") == 0)
+			iFps = atoi(argv[i + 1]);
+		else if (strcmp(szArg, "-start") == 0)
+			fStartTime = (float)atof(argv[i + 1]);
+		else if (strcmp(szArg, "-end") == 0)
+			fEndTime = (float)atof(argv[i + 1]);
+		else if (strcmp(szArg, "-size") == 0) {
+			iWidth = atoi(argv[i + 1]);
+			iHeight = atoi(argv[i + 2]);
+		}
+		else if (strcmp(szArg, "-jobs") == 0)
+			iJobs = atoi(argv[i + 1]);
+		else if (strcmp(szArg, "-frames") == 0) {
+			iFirstFrame = atoi(argv[i + 1]);
+			iLastFrame = atoi(argv[i + 2]);
+		}
+		else if (strcmp(szArg, "-particles") == 0)
+			strParticleFileName = argv[i + 1];
+		else if (strcmp(szArg, "-format") == 0)
+			strFormat = argv[i + 1];
+		else {
+			fprintf(stderr, "ERROR: unknown option %s\n", szArg);
+			printBatchUsage();
+			return false;
+		}
+		i += iValues;
+	}
+
+	if (strScriptFileName.empty() || iFps <= 0 || iWidth <= 0 || iHeight <= 0 || iJobs <= 0) {
+		printBatchUsage();
+		return false;
+	}
+
+	FrameWriter* pfwWriter = FrameWriter::create(strFormat.c_str());
+	if (!pfwWriter) {
+		fprintf(stderr, "ERROR: unknown frame format %s\n", strFormat.c_str());
+		printBatchUsage();
+		return false;
+	}
+	bool bStreaming = pfwWriter->streaming();
+	delete pfwWriter;
+	if (bStreaming && iJobs > 1) {
+		fprintf(stderr, "ERROR: the %s format is streamed and cannot be split into jobs\n",
+			strFormat.c_str());
+		return false;
+	}
+
+	// frames go next to the script unless told otherwise
+	if (strOutputBaseName.empty())
+		strOutputBaseName = strScriptFileName;
+
+	return true;
+}
+
+static std::string intArg(int iValue)
+{
+	char szValue[32];
+	_snprintf(szValue, 32, "%d", iValue);
+	szValue[31] = 0;
+	return szValue;
+}
+
+// a process handle on windows, a pid elsewhere
+typedef intptr_t JobHandle;
+
+#ifdef WIN32
+// quotes an argument so that CommandLineToArgvW, and the C runtime, split
+// it out again as it was: a quote is escaped with a backslash, and the
+// backslashes in front of a quote, or of the closing quote, are doubled
+static std::string quoteArg(const std::string& strArg)
+{
+	std::string strQuoted = "\"";
+	for (size_t i = 0; ; ++i) {
+		size_t iBackslashes = 0;
+		for (; i < strArg.size() && strArg[i] == '\\'; ++i)
+			++iBackslashes;
+
+		if (i == strArg.size()) {
+			strQuoted.append(2 * iBackslashes, '\\');
+			break;
+		}
+		if (strArg[i] == '"')
+			strQuoted.append(2 * iBackslashes + 1, '\\');
+		else
+			strQuoted.append(iBackslashes, '\\');
+		strQuoted += strArg[i];
+	}
+	strQuoted += '"';
+	return strQuoted;
+}
+#endif // WIN32
+
+// starts the program on one range of frames; returns a handle to wait on,
+// or 0 on failure
+static JobHandle startBatchJob(const BatchOptions& options, int iFirstFrame, int iLastFrame)
+{
+	std::vector<std::string> strvArgs;
+	strvArgs.push_back(options.strProgramName);
+	strvArgs.push_back("-batch");
+	strvArgs.push_back(options.strScriptFileName);
+	strvArgs.push_back("-out");
+	strvArgs.push_back(options.strOutputBaseName);
+	strvArgs.push_back("-fps");
+	strvArgs.push_back(intArg(options.iFps));
+	strvArgs.push_back("-size");
+	strvArgs.push_back(intArg(options.iWidth));
+	strvArgs.push_back(intArg(options.iHeight));
+	strvArgs.push_back("-format");
+	strvArgs.push_back(options.strFormat);
+	strvArgs.push_back("-frames");
+	strvArgs.push_back(intArg(iFirstFrame));
+	strvArgs.push_back(intArg(iLastFrame));
+	if (!options.strParticleFileName.empty()) {
+		strvArgs.push_back("-particles");
+		strvArgs.push_back(options.strParticleFileName);
+	}
+
+#ifdef WIN32
+	std::string strCommandLine;
+	for (size_t i = 0; i < strvArgs.size(); ++i) {
+		if (i > 0)
+			strCommandLine += ' ';
+		strCommandLine += quoteArg(strvArgs[i]);
+	}
+
+	STARTUPINFOA si;
+	PROCESS_INFORMATION pi;
+	memset(&si, 0, sizeof(si));
+	si.cb = sizeof(si);
+	if (!CreateProcessA(NULL, &strCommandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
+		return 0;
+	CloseHandle(pi.hThread);
+	return (JobHandle)pi.hProcess;
+#else
+	std::vector<char*> szvArgs;
+	for (size_t i = 0; i < strvArgs.size(); ++i)
+		szvArgs.push_back(&strvArgs[i][0]);
+	szvArgs.push_back(NULL);
+
+	pid_t pid;
+	if (posix_spawnp(&pid, szvArgs[0], NULL, NULL, &szvArgs[0], environ) != 0)
+		return 0;
+	return (JobHandle)pid;
+#endif // WIN32
+}
+
+// waits for a job; returns true if it succeeded
+static bool waitBatchJob(JobHandle hJob)
+{
+#ifdef WIN32
+	HANDLE hProcess = (HANDLE)hJob;
+	DWORD dwExitCode = 1;
+	WaitForSingleObject(hProcess, INFINITE);
+	GetExitCodeProcess(hProcess, &dwExitCode);
+	CloseHandle(hProcess);
+	return dwExitCode == 0;
+#else
+	int iStatus;
+	if (waitpid((pid_t)hJob, &iStatus, 0) < 0)
+		return false;
+	return WIFEXITED(iStatus) && WEXITSTATUS(iStatus) == 0;
+#endif // WIN32
+}
+
+int runBatchJobs(const BatchOptions& options, int iFirstFrame, int iLastFrame)
+{
+	int iFrameCount = iLastFrame - iFirstFrame + 1;
+	int iJobs = options.iJobs < iFrameCount ? options.iJobs : iFrameCount;
+	if (iJobs <= 0)
+		return 0;
+
+	// consecutive ranges keep each job stepping forward through time,
+	// the first iFrameCount % iJobs of them get one extra frame
+	std::vector<JobHandle> hvJobs(iJobs, 0);
+	std::vector<int> ivFirstFrames(iJobs), ivLastFrames(iJobs);
+	int iFrame = iFirstFrame;
+	for (int iJob = 0; iJob < iJobs; ++iJob) {
+		int iCount = iFrameCount / iJobs + (iJob < iFrameCount % iJobs ? 1 : 0);
+		ivFirstFrames[iJob] = iFrame;
+		ivLastFrames[iJob] = iFrame + iCount - 1;
+		iFrame += iCount;
+
+		hvJobs[iJob] = startBatchJob(options, ivFirstFrames[iJob], ivLastFrames[iJob]);
+		if (!hvJobs[iJob])
+			fprintf(stderr, "ERROR: cannot start the job for frames %d to %d\n",
+				ivFirstFrames[iJob], ivLastFrames[iJob]);
+	}
+
+	int iFailed = 0;
+	for (int iJob = 0; iJob < iJobs; ++iJob) {
+		if (hvJobs[iJob] && waitBatchJob(hvJobs[iJob]))
+			continue;
+		if (hvJobs[iJob])
+			fprintf(stderr, "ERROR: the job for frames %d to %d failed\n",
+				ivFirstFrames[iJob], ivLastFrames[iJob]);
+		++iFailed;
+	}
+
+	if (iFailed > 0)
+		return -1;
+
+	printf("%d frames written to %s by %d jobs\n", iFrameCount,
+		options.strOutputBaseName.c_str(), iJobs);
+	return 0;
+}
+
+OffscreenContext::OffscreenContext() :
+	m_pvContext(NULL),
+	m_iWidth(0),
+	m_iHeight(0),
+	m_pvWindow(NULL),
+	m_pvDC(NULL),
+	m_uiFramebuffer(0),
+	m_uiColorRenderbuffer(0),
+	m_uiDepthRenderbuffer(0)
+{
+}
+
+OffscreenContext::~OffscreenContext()
+{
+	destroy();
+}
+
+#ifdef USE_OSMESA
+bool OffscreenContext::create(int iWidth, int iHeight)
+{
+	destroy();
+
+
+	// rgba with a 24 bit depth buffer, like the window's visual
+	OSMesaContext ctx = OSMesaCreateContextExt(OSMESA_RGBA, 24, 0, 0, NULL);
+	if (!ctx)
+		return false;
+
+	m_pvContext = ctx;
+	m_ucvColorBuffer.resize(4 * iWidth * iHeight);
+	m_iWidth = iWidth;
+	m_iHeight = iHeight;
+	return makeCurrent();
+}
+#elif defined(WIN32)
+bool OffscreenContext::create(int iWidth, int iHeight)
+{
+	destroy();
+
+	// a context needs a window, but it is never shown; the frames go to a
+	// framebuffer object, so the window's size does not matter
+	WNDCLASSA wc;
+	memset(&wc, 0, sizeof(wc));
+	wc.style = CS_OWNDC;
+	wc.lpfnWndProc = DefWindowProcA;
+	wc.hInstance = GetModuleHandleA(NULL);
+	wc.lpszClassName = s_szOffscreenWindowClass;
+	// fails harmlessly when the class is already registered
+	RegisterClassA(&wc);
+
+	HWND hWnd = CreateWindowA(s_szOffscreenWindowClass, "", WS_POPUP, 0, 0, 1, 1, 
+		NULL, NULL, wc.hInstance, NULL);
+	if (!hWnd)
+		return false;
+	m_pvWindow = hWnd;
+	HDC hDC = GetDC(hWnd);
+	m_pvDC = hDC;
+
+	PIXELFORMATDESCRIPTOR pfd;
+	memset(&pfd, 0, sizeof(pfd));
+	pfd.nSize = sizeof(pfd);
+	pfd.nVersion = 1;
+	pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL;
+	pfd.iPixelType = PFD_TYPE_RGBA;
+	pfd.cColorBits = 24;
+	pfd.cDepthBits = 24;
+	pfd.iLayerType = PFD_MAIN_PLANE;
+	int iPixelFormat = ChoosePixelFormat(hDC, &pfd);
+	if (!iPixelFormat || !SetPixelFormat(hDC, iPixelFormat, &pfd)) {
+		destroy();
+		return false;
+	}
+
+	HGLRC hContext = wglCreateContext(hDC);
+	if (!hContext) {
+		destroy();
+		return false;
+	}
+	m_pvContext = hContext;
+	if (!wglMakeCurrent(hDC, hContext)) {
+		destroy();
+		return false;
+	}
+
+	const char* szExtensions = (const char*)glGetString(GL_EXTENSIONS);
+	if (!szExtensions || !strstr(szExtensions, "GL_EXT_framebuffer_object")) {
+		destroy();
+		return false;
+	}
+
+	s_pfnGenFramebuffers = (GenFramebuffersProc)wglGetProcAddress("glGenFramebuffersEXT");
+	s_pfnDeleteFramebuffers = (DeleteFramebuffersProc)wglGetProcAddress("glDeleteFramebuffersEXT");
+	s_pfnBindFramebuffer = (BindFramebufferProc)wglGetProcAddress("glBindFramebufferEXT");
+	s_pfnCheckFramebufferStatus = (CheckFramebufferStatusProc)wglGetProcAddress("glCheckFramebufferStatusEXT");
+	s_pfnGenRenderbuffers = (GenRenderbuffersProc)wglGetProcAddress("glGenRenderbuffersEXT");
+	s_pfnDeleteRenderbuffers = (DeleteRenderbuffersProc)wglGetProcAddress("glDeleteRenderbuffersEXT");
+	s_pfnBindRenderbuffer = (BindRenderbufferProc)wglGetProcAddress("glBindRenderbufferEXT");
+	s_pfnRenderbufferStorage = (RenderbufferStorageProc)wglGetProcAddress("glRenderbufferStorageEXT");
+	s_pfnFramebufferRenderbuffer = (FramebufferRenderbufferProc)wglGetProcAddress("glFramebufferRenderbufferEXT");
+	if (!s_pfnGenFramebuffers || !s_pfnDeleteFramebuffers || !s_pfnBindFramebuffer ||
+		!s_pfnCheckFramebufferStatus || !s_pfnGenRenderbuffers || !s_pfnDeleteRenderbuffers ||
+		!s_pfnBindRenderbuffer || !s_pfnRenderbufferStorage || !s_pfnFramebufferRenderbuffer) {
+		destroy();
+		return false;
+	}
+
+	// rgba with a 24 bit depth buffer, like the window's visual
+	s_pfnGenRenderbuffers(1, &m_uiColorRenderbuffer);
+	s_pfnBindRenderbuffer(GL_RENDERBUFFER_EXT, m_uiColorRenderbuffer);
+	s_pfnRenderbufferStorage(GL_RENDERBUFFER_EXT, GL_RGBA8, iWidth, iHeight);
+	s_pfnGenRenderbuffers(1, &m_uiDepthRenderbuffer);
+	s_pfnBindRenderbuffer(GL_RENDERBUFFER_EXT, m_uiDepthRenderbuffer);
+	s_pfnRenderbufferStorage(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, iWidth, iHeight);
+	s_pfnBindRenderbuffer(GL_RENDERBUFFER_EXT, 0);
+
+	s_pfnGenFramebuffers(1, &m_uiFramebuffer);
+	s_pfnBindFramebuffer(GL_FRAMEBUFFER_EXT, m_uiFramebuffer);
+	s_pfnFramebufferRenderbuffer(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, 
+		GL_RENDERBUFFER_EXT, m_uiColorRenderbuffer);
+	s_pfnFramebufferRenderbuffer(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, 
+		GL_RENDERBUFFER_EXT, m_uiDepthRenderbuffer);
+	if (s_pfnCheckFramebufferStatus(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT) {
+		destroy();
+		return false;
+	}
+
+	m_iWidth = iWidth;
+	m_iHeight = iHeight;
+	return makeCurrent();
+}
+#else
+bool OffscreenContext::create(int, int)
+{
+	destroy();
+	return false;
+}
+#endif // USE_OSMESA
+
+bool OffscreenContext::makeCurrent()
+{
+	if (!m_pvContext)
+		return false;
+
+#ifdef USE_OSMESA
+	return OSMesaMakeCurrent((OSMesaContext)m_pvContext, &m_ucvColorBuffer[0],
+		GL_UNSIGNED_BYTE, m_iWidth, m_iHeight) == GL_TRUE;
+#elif defined(WIN32)
+	// drawing and glReadPixels both go to the framebuffer object
+	if (!wglMakeCurrent((HDC)m_pvDC, (HGLRC)m_pvContext))
+		return false;
+	s_pfnBindFramebuffer(GL_FRAMEBUFFER_EXT, m_uiFramebuffer);
+	return true;
+#else
+	return false;
+#endif // USE_OSMESA
+}
+
+void OffscreenContext::destroy()
+{
+#ifdef USE_OSMESA
+	if (m_pvContext)
+		OSMesaDestroyContext((OSMesaContext)m_pvContext);
+#elif defined(WIN32)
+	if (m_pvContext && wglMakeCurrent((HDC)m_pvDC, (HGLRC)m_pvContext)) {
+		if (m_uiFramebuffer) {
+			s_pfnBindFramebuffer(GL_FRAMEBUFFER_EXT, 0);
+			s_pfnDeleteFramebuffers(1, &m_uiFramebuffer);
+		}
+		if (m_uiColorRenderbuffer)
+			s_pfnDeleteRenderbuffers(1, &m_uiColorRenderbuffer);
+		if (m_uiDepthRenderbuffer)
+			s_pfnDeleteRenderbuffers(1, &m_uiDepthRenderbuffer);
+		wglMakeCurrent(NULL, NULL);
+	}
+	if (m_pvContext)
+		wglDeleteContext((HGLRC)m_pvContext);
+	if (m_pvDC)
+		ReleaseDC((HWND)m_pvWindow, (HDC)m_pvDC);
+	if (m_pvWindow)
+		DestroyWindow((HWND)m_pvWindow);
+	m_pvWindow = NULL;
+	m_pvDC = NULL;
+	m_uiFramebuffer = 0;
+	m_uiColorRenderbuffer = 0;
+	m_uiDepthRenderbuffer = 0;
+#endif // USE_OSMESA
+	m_pvContext = NULL;
+	m_ucvColorBuffer.clear();
+}
@@ -0,0 +1,87 @@
+#ifndef BATCHRENDER_H_INCLUDED
+#define BATCHRENDER_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <string>
+#include <vector>
+
+// Command line options of the batch mode, which renders an animation
+// script to numbered image files without user interaction:
+//
+//   -batch script.ani [-out prefix] [-fps n] [-start t] [-end t]
+//                     [-size width height] [-jobs n]
+//                     [-format bmp|qoi|y4m|rgb]
+//
+// The y4m and rgb formats stream the frames to stdout instead of files,
+// so they cannot be split into jobs.
+// The camera keyframes are read from script.ani.cam, like when the script
+// is opened from the menu. With -jobs the frames are split into n
+// contiguous ranges, each rendered by its own process; the jobs are
+// started with -frames and -particles so that they only render their
+// range and all draw the same simulated particles.
+struct BatchOptions
+{
+	BatchOptions();
+
+	// true when the command line asks for the batch mode
+	static bool requested(int argc, char** argv);
+	// returns false and prints the usage on a malformed command line
+	bool parse(int argc, char** argv);
+
+	std::string strScriptFileName;
+	std::string strOutputBaseName;
+	int iFps;
+	// negative times stand for the start and the end of the script
+	float fStartTime;
+	float fEndTime;
+	int iWidth;
+	int iHeight;
+	int iJobs;
+	std::string strFormat;
+	// the range of a job, -1 when rendering the whole time range
+	int iFirstFrame;
+	int iLastFrame;
+	// particle bake shared by the jobs, empty to simulate while rendering
+	std::string strParticleFileName;
+	// the running program, which starts the jobs
+	std::string strProgramName;
+};
+
+// Renders frames iFirstFrame to iLastFrame by starting options.iJobs
+// copies of the program on consecutive ranges of them, and waits for all
+// of them to finish. Every job writes its frames under the shared output
+// name and frame numbering, so together they leave the same files as a
+// single process would. Returns the exit code of the program.
+int runBatchJobs(const BatchOptions& options, int iFirstFrame, int iLastFrame);
+
+// GL context for rendering without a display. With USE_OSMESA defined the
+// frames are rendered in software by OSMesa into a buffer in memory. On
+// windows the context belongs to a window that is never shown, and the
+// frames are drawn into a framebuffer object of the given size. create()
+// fails when neither is available, and the caller renders into a window.
+class OffscreenContext
+{
+public:
+	OffscreenContext();
+	~OffscreenContext();
+
+	bool create(int iWidth, int iHeight);
+	bool makeCurrent();
+	void destroy();
+
+protected:
+	void* m_pvContext;
+	std::vector<unsigned char> m_ucvColorBuffer;
+	int m_iWidth;
+	int m_iHeight;
+	// the hidden window and its device context, and the framebuffer
+	// object with its color and depth renderbuffers
+	void* m_pvWindow;
+	void* m_pvDC;
+	unsigned int m_uiFramebuffer;
+	unsigned int m_uiColorRenderbuffer;
+	unsigned int m_uiDepthRenderbuffer;
+};
+
+#endif // BATCHRENDER_H_INCLUDED
@@ -10,11 +10,12 @@
 class BezierCurveEvaluator : public CurveEvaluator
 {
 public:
-	void evaluateCurve(const std::vector<Point>& ptvCtrlPts,
+	void evaluateCurve(const Point* pptCtrlPts,
+		const int iCtrlPtCount,
 		std::vector<Point>& ptvEvaluatedCurvePts,
 		const float& fAniLength,
-		const bool& bWrap) const;
-	void displayBezier(Point v0, Point v1, Point v2, Point v3, std::vector<Point>& ptvEvaluatedCurvePts, float fAniLength) const;
+		const bool& bWrap,
+		CurveEvaluationScratch& scratch) const;
 };
 
 #endif
\ No newline at end of file
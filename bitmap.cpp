@@ -8,6 +8,15 @@
  
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // WIN32
 
 #define BMP_BI_RGB        0L
 
@@ -44,98 +53,244 @@ typedef struct {
 
 #pragma pack(pop)
 
-BMP_BITMAPFILEHEADER bmfh; 
-BMP_BITMAPINFOHEADER bmih; 
+// swap the red and blue bytes of 16 bytes at a time (5 pixels and one
+// byte of the next) when SSSE3 is available. MSVC compiles the
+// intrinsics without /arch, so there the processor is asked once.
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define BITMAP_USE_SSSE3
+#include <intrin.h>
+#include <tmmintrin.h>
+static bool checkSSSE3()
+{
+	int ivCpuInfo[4];
+	__cpuid(ivCpuInfo, 1);
+	return ((ivCpuInfo[2] >> 9) & 1) != 0;
+}
+// set before main, since files may be opened from several threads
+static const bool s_bHasSSSE3 = checkSSSE3();
+static bool hasSSSE3()
+{
+	return s_bHasSSSE3;
+}
+#elif defined(__SSSE3__)
+#define BITMAP_USE_SSSE3
+#include <tmmintrin.h>
+static bool hasSSSE3()
+{
+	return true;
+}
+#endif
 
-unsigned char* readBMP(const char *szFileName, int& iWidth, int& iHeight)
-{ 
-	FILE* pfBMPFile;
-	BMP_DWORD dwPos;
-	unsigned char *pbyData = NULL; 
- 
-	do {
-		if ((pfBMPFile = fopen(szFileName, "rb")) == NULL)
-			break; 
+static void swizzleRow(const unsigned char* pbyIn, unsigned char* pbyOut, int iWidth)
+{
+	int iBytes = 3 * iWidth;
+	int i = 0;
+#ifdef BITMAP_USE_SSSE3
+	if (hasSSSE3()) {
+		const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+		// the 16th byte is written again by the next step, so stop while a
+		// whole 16 bytes remain
+		for (; i + 16 <= iBytes; i += 15) {
+			__m128i pixels = _mm_loadu_si128((const __m128i*)(pbyIn + i));
+			_mm_storeu_si128((__m128i*)(pbyOut + i), _mm_shuffle_epi8(pixels, mask));
+		}
+	}
+#endif // BITMAP_USE_SSSE3
+	for (; i < iBytes; i += 3) {
+		pbyOut[i] = pbyIn[i + 2];
+		pbyOut[i + 1] = pbyIn[i + 1];
+		pbyOut[i + 2] = pbyIn[i];
+	}
+}
 
-		fread(&bmfh, sizeof(BMP_BITMAPFILEHEADER), 1, pfBMPFile);
+BMPView::BMPView() :
+	m_pbyFile(NULL),
+	m_pbyBottomRow(NULL),
+	m_iRowStride(0),
+	m_iWidth(0),
+	m_iHeight(0),
+#ifdef WIN32
+	m_hFile(INVALID_HANDLE_VALUE),
+	m_hMapping(NULL)
+#else
+	m_stFileSize(0)
+#endif // WIN32
+{
+}
 
-		dwPos = bmfh.bfOffBits; 
- 
-		fread(&bmih, sizeof(BMP_BITMAPINFOHEADER), 1, pfBMPFile); 
- 
-		// error checking
-		if (bmfh.bfType!= 0x4d42) {	// "BM" actually
-			break;
-		}
-		if (bmih.biBitCount != 24)  
-			break;
-		/*
- 		if (bmih.biCompression != BMP_BI_RGB) {
-			return NULL;
-		}
-		*/
-		fseek(pfBMPFile, dwPos, SEEK_SET); 
- 
-		iWidth = bmih.biWidth; 
-		iHeight = bmih.biHeight; 
- 
-		int iPadWidth = iWidth * 3; 
-		int iPad = 0; 
-		if (iPadWidth % 4 != 0) { 
-			iPad = 4 - (iPadWidth % 4); 
-			iPadWidth += iPad; 
-		} 
-		int iBytes = iHeight * iPadWidth; 
- 
-		pbyData = new unsigned char[iBytes]; 
-
-		int iBytesRead = fread(pbyData, iBytes, 1, pfBMPFile); 
-		
-		if (!iBytesRead) {
-			delete [] pbyData;
-			pbyData = NULL;
-			break;
-		}
+BMPView::~BMPView()
+{
+	close();
+}
+
+bool BMPView::open(const char* szFileName)
+{
+	close();
 
-		// shuffle bitmap data such that it is (R,G,B) tuples in row-major order
-		// also get away with the padding
-		int i, j;
-		j = 0;
-		unsigned char byTemp;
-		unsigned char* pbyIn;
-		unsigned char* pbyOut;
-
-		pbyIn = pbyData;
-		pbyOut = pbyData;
-
-		for (j = 0; j < iHeight; ++j) {
-			for (i = 0; i < iWidth; ++i) {
-				pbyOut[1] = pbyIn[1];
-				byTemp = pbyIn[2];
-				pbyOut[2] = pbyIn[0];
-				pbyOut[0] = byTemp;
-
-				pbyIn += 3;
-				pbyOut += 3;
-			}
-			pbyIn += iPad;
+	size_t stFileSize;
+
+#ifdef WIN32
+	m_hFile = CreateFileA(szFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER liFileSize;
+	// a file too large to map whole is not a bitmap this can show
+	if (!GetFileSizeEx(m_hFile, &liFileSize) || liFileSize.QuadPart == 0 ||
+		(UINT64)liFileSize.QuadPart > (UINT64)(size_t)-1) {
+		close();
+		return false;
+	}
+	stFileSize = (size_t)liFileSize.QuadPart;
+	m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_hMapping)
+		m_pbyFile = (const unsigned char*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	int fd = ::open(szFileName, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0 && (unsigned long long)st.st_size <= (size_t)-1) {
+		void* pvFile = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (pvFile != MAP_FAILED) {
+			m_pbyFile = (const unsigned char*)pvFile;
+			m_stFileSize = (size_t)st.st_size;
 		}
-	} while (false);
+	}
+	// the mapping stays valid without the descriptor
+	::close(fd);
+	stFileSize = m_stFileSize;
+#endif // WIN32
 
-	if (pfBMPFile)
-		fclose(pfBMPFile);
+	if (!m_pbyFile) {
+		close();
+		return false;
+	}
+
+	// copy the headers out, the mapping gives no alignment guarantees
+	BMP_BITMAPFILEHEADER bmfh;
+	BMP_BITMAPINFOHEADER bmih;
+	if (stFileSize < sizeof(BMP_BITMAPFILEHEADER) + sizeof(BMP_BITMAPINFOHEADER)) {
+		close();
+		return false;
+	}
+	memcpy(&bmfh, m_pbyFile, sizeof(BMP_BITMAPFILEHEADER));
+	memcpy(&bmih, m_pbyFile + sizeof(BMP_BITMAPFILEHEADER), sizeof(BMP_BITMAPINFOHEADER));
+
+	// error checking
+	if (bmfh.bfType != 0x4d42 ||	// "BM" actually
+		bmih.biBitCount != 24 ||
+		bmih.biCompression != BMP_BI_RGB ||
+		bmih.biWidth <= 0 || bmih.biHeight == 0) {
+		close();
+		return false;
+	}
+
+	// the sizes are worked out in size_t. A padded row has to fit the int
+	// row stride, and the rows together a size_t, before the pixels are
+	// compared with the file.
+	size_t stWidth = (size_t)bmih.biWidth;
+	size_t stHeight = bmih.biHeight < 0 ? (size_t)(-(long long)bmih.biHeight) : (size_t)bmih.biHeight;
+	if (stWidth > ((size_t)INT_MAX - 3) / 3 || stHeight > (size_t)INT_MAX) {
+		close();
+		return false;
+	}
+	size_t stPadWidth = (stWidth * 3 + 3) & ~(size_t)3;
+	if (stHeight > (size_t)-1 / stPadWidth) {
+		close();
+		return false;
+	}
+	size_t stPixelBytes = stPadWidth * stHeight;
+
+	// the pixels must be inside the file
+	if (bmfh.bfOffBits > stFileSize || stFileSize - bmfh.bfOffBits < stPixelBytes) {
+		close();
+		return false;
+	}
+
+	m_iWidth = (int)stWidth;
+	m_iHeight = (int)stHeight;
+	const unsigned char* pbyPixels = m_pbyFile + bmfh.bfOffBits;
+	if (bmih.biHeight > 0) {
+		m_pbyBottomRow = pbyPixels;
+		m_iRowStride = (int)stPadWidth;
+	}
+	else {
+		m_pbyBottomRow = pbyPixels + (stHeight - 1) * stPadWidth;
+		m_iRowStride = -(int)stPadWidth;
+	}
+	return true;
+}
+
+void BMPView::close()
+{
+#ifdef WIN32
+	if (m_pbyFile)
+		UnmapViewOfFile(m_pbyFile);
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+#else
+	if (m_pbyFile)
+		munmap((void*)m_pbyFile, m_stFileSize);
+	m_stFileSize = 0;
+#endif // WIN32
+	m_pbyFile = NULL;
+	m_pbyBottomRow = NULL;
+	m_iRowStride = 0;
+	m_iWidth = 0;
+	m_iHeight = 0;
+}
+
+const unsigned char* BMPView::row(int j) const
+{
+	return m_pbyBottomRow + (ptrdiff_t)j * m_iRowStride;
+}
+
+void BMPView::copyRGB(unsigned char* pbyData) const
+{
+	for (int j = 0; j < m_iHeight; ++j)
+		swizzleRow(row(j), pbyData + (size_t)j * 3 * m_iWidth, m_iWidth);
+}
+
+unsigned char* readBMP(const char *szFileName, int& iWidth, int& iHeight)
+{ 
+	BMPView bmpView;
+	if (!bmpView.open(szFileName))
+		return NULL;
+
+	iWidth = bmpView.width();
+	iHeight = bmpView.height();
 
+	// (R,G,B) tuples in row-major order, without the padding
+	// open() checked that this many bytes can be counted in a size_t
+	unsigned char* pbyData = new unsigned char[(size_t)3 * iWidth * iHeight];
+	bmpView.copyRGB(pbyData);
 	return pbyData; 
 } 
  
-bool writeBMP(const char* szFileName, int iWidth, int iHeight, const unsigned char* pbyData) 
-{ 
+int bmpFileSize(int iWidth, int iHeight)
+{
+	int iPadWidth = iWidth * 3;
+	iPadWidth += (iPadWidth % 4) ? 4 - (iPadWidth % 4) : 0;
+	return sizeof(BMP_BITMAPFILEHEADER) + sizeof(BMP_BITMAPINFOHEADER) + iPadWidth * iHeight;
+}
+
+void encodeBMP(int iWidth, int iHeight, const unsigned char* pbyData, unsigned char* pbyFile)
+{
 	int iBytes, iPad;
 	iBytes = iWidth * 3;
 	iPad = (iBytes % 4) ? 4 - (iBytes % 4) : 0;
 	iBytes += iPad;
 	iBytes *= iHeight;
 
+	// local headers, so that frames can be written from another thread
+	BMP_BITMAPFILEHEADER bmfh;
+	BMP_BITMAPINFOHEADER bmih;
+
 	bmfh.bfType = 0x4d42; // "BM"
 	bmfh.bfSize = sizeof(BMP_BITMAPFILEHEADER) + sizeof(BMP_BITMAPINFOHEADER) + iBytes;
 	bmfh.bfReserved1 = 0;
@@ -154,28 +309,44 @@ bool writeBMP(const char* szFileName, int iWidth, int iHeight, const unsigned ch
 	bmih.biClrUsed = 0;
 	bmih.biClrImportant = 0;
 
+	memcpy(pbyFile, &bmfh, sizeof(BMP_BITMAPFILEHEADER));
+	pbyFile += sizeof(BMP_BITMAPFILEHEADER);
+	memcpy(pbyFile, &bmih, sizeof(BMP_BITMAPINFOHEADER));
+	pbyFile += sizeof(BMP_BITMAPINFOHEADER);
+
+	// bmp rows are bottom up like the gl frame buffer, only the
+	// channels are swapped to (B,G,R) and the rows padded
+	for (int j = 0; j < iHeight; ++j) {
+		const unsigned char* pbyIn = pbyData + j * 3 * iWidth;
+		for (int i = 0; i < iWidth; ++i) {
+			pbyFile[0] = pbyIn[2];
+			pbyFile[1] = pbyIn[1];
+			pbyFile[2] = pbyIn[0];
+			pbyIn += 3;
+			pbyFile += 3;
+		}
+		for (int i = 0; i < iPad; ++i)
+			*pbyFile++ = 0;
+	}
+}
+
+bool writeBMP(const char* szFileName, int iWidth, int iHeight, const unsigned char* pbyData) 
+{ 
 	FILE* pfBMPFile = fopen(szFileName, "wb");
 
 	if (pfBMPFile) {
-		fwrite(&bmfh, sizeof(BMP_BITMAPFILEHEADER), 1, pfBMPFile);
-		fwrite(&bmih, sizeof(BMP_BITMAPINFOHEADER), 1, pfBMPFile); 
-
-		iBytes /= iHeight;
-		unsigned char* pbyScanLine = new unsigned char[iBytes];
-		for (int j = 0; j < iHeight; ++j) {
-			memcpy(pbyScanLine, pbyData + j * 3 * iWidth, iBytes);
-			for (int i = 0; i < iWidth; ++i) {
-				unsigned char byTemp = pbyScanLine[i * 3];
-				pbyScanLine[i * 3] = pbyScanLine[i * 3 + 2];
-				pbyScanLine[i * 3 + 2] = byTemp;
-			}
-			fwrite(pbyScanLine, iBytes, 1, pfBMPFile);
-		}
+		// encode the whole file first and hand it over in one write
+		int iFileSize = bmpFileSize(iWidth, iHeight);
+		unsigned char* pbyFile = new unsigned char[iFileSize];
+		encodeBMP(iWidth, iHeight, pbyData, pbyFile);
+
+		setvbuf(pfBMPFile, NULL, _IONBF, 0);
+		bool bWritten = fwrite(pbyFile, iFileSize, 1, pfBMPFile) == 1;
 
-		delete [] pbyScanLine;
+		delete [] pbyFile;
 		fclose(pfBMPFile);
-		return true;
+		return bWritten;
 	}
 
 	return false;
-} 
+}
@@ -8,8 +8,56 @@
 #ifndef BITMAP_H
 #define BITMAP_H
 
+#include <stddef.h>
+
+// A 24 bit bitmap file mapped into memory. The pixels are read straight
+// from the mapping, so nothing is copied until copyRGB(), and unlike the
+// old loader no state is shared, so several files can be opened at once
+// from different threads.
+class BMPView
+{
+public:
+	BMPView();
+	~BMPView();
+
+	// maps the file and checks its headers; false if it is not an
+	// uncompressed 24 bit bitmap or is cut short
+	bool open(const char *fname);
+	void close();
+
+	int width() const { return m_iWidth; }
+	int height() const { return m_iHeight; }
+	// row j counts from the bottom of the image, with (B,G,R) pixels
+	const unsigned char *row(int j) const;
+
+	// converts to tightly packed (R,G,B) rows from the bottom up, the
+	// layout readBMP returns and glTexImage2D expects
+	void copyRGB(unsigned char *data) const;
+
+private:
+	BMPView(const BMPView&);
+	BMPView& operator=(const BMPView&);
+
+	const unsigned char *m_pbyFile;
+	const unsigned char *m_pbyBottomRow;
+	int m_iRowStride;	// negative for files stored top down
+	int m_iWidth;
+	int m_iHeight;
+#ifdef WIN32
+	void *m_hFile;
+	void *m_hMapping;
+#else
+	size_t m_stFileSize;
+#endif // WIN32
+};
+
 // global I/O routines
 extern unsigned char *readBMP(const char *fname, int& width, int& height);
 extern bool writeBMP(const char *iname, int width, int height, const unsigned char *data); 
 
+// in-memory encoding, for writers that keep their own buffer: bmpFileSize
+// returns the size of the file encodeBMP fills in
+extern int bmpFileSize(int width, int height);
+extern void encodeBMP(int width, int height, const unsigned char *data, unsigned char *file);
+
 #endif
\ No newline at end of file
@@ -10,12 +10,14 @@
 class BSplineEvaluator : public CurveEvaluator
 {
 public:
-	void evaluateCurve(const std::vector<Point>& ptvCtrlPts,
+	void evaluateCurve(const Point* pptCtrlPts,
+		const int iCtrlPtCount,
 		std::vector<Point>& ptvEvaluatedCurvePts,
 		const float& fAniLength,
-		const bool& bWrap) const;
-	void displayBezier(Point v0, Point v1, Point v2, Point v3, std::vector<Point>& ptvEvaluatedCurvePts, float fAniLength) const;
-	std::vector<Point> convertDeBoor(Point b0, Point b1, Point b2, Point b3) const;
+		const bool& bWrap,
+		CurveEvaluationScratch& scratch) const;
+	// writes the four bezier control points of the segment to pptBezier
+	void convertDeBoor(const Point& b0, const Point& b1, const Point& b2, const Point& b3, Point* pptBezier) const;
 };
 
 #endif
\ No newline at end of file
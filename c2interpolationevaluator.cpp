@@ -1,163 +1,150 @@
 #include "C2InterpolationEvaluator.h"
 #include <assert.h>
 
-void C2InterpolationEvaluator::evaluateCurve(const std::vector<Point>& ptvCtrlPts,
+void C2InterpolationEvaluator::evaluateCurve(const Point* pptCtrlPts,
+	const int iCtrlPtCount,
 	std::vector<Point>& ptvEvaluatedCurvePts,
 	const float& fAniLength,
-	const bool& bWrap) const
+	const bool& bWrap,
+	CurveEvaluationScratch& scratch) const
 {
-	std::vector<Point> ctrlPts = ptvCtrlPts;
-
 	// make sure the evaluated curve points are empty from the start
 	ptvEvaluatedCurvePts.clear();
-	int iCtrlPtCount = ctrlPts.size();
 
 	// find velocity vectors
-	std::vector<Point> velocityVectors = calculateVelocity(ctrlPts, bWrap, fAniLength);
+	calculateVelocity(pptCtrlPts, iCtrlPtCount, bWrap, fAniLength, scratch);
+	const std::vector<Point>& velocityVectors = scratch.ptvVelocities;
+
+	const Point& ptFirst = pptCtrlPts[0];
+	const Point& ptLast = pptCtrlPts[iCtrlPtCount - 1];
 
+	// the pieces are emitted from left to right: the head (either the
+	// horizontal start or the wrap-around segment clipped at 0), the
+	// interpolating segments, then the matching tail
 	if (!bWrap){
 		// if the curve is not wrapped, make the beginning and the end of the curve horizontal
-		ptvEvaluatedCurvePts.push_back(Point(0.0, ctrlPts[0].y));
-		ptvEvaluatedCurvePts.push_back(Point(fAniLength, ctrlPts[iCtrlPtCount - 1].y));
-
-		ptvEvaluatedCurvePts.push_back(ctrlPts[0]);
-		ptvEvaluatedCurvePts.push_back(ctrlPts[iCtrlPtCount - 1]);
+		ptvEvaluatedCurvePts.push_back(Point(0.0, ptFirst.y));
+		ptvEvaluatedCurvePts.push_back(ptFirst);
 	}
 	else{
-		displayC2(Point(ctrlPts[iCtrlPtCount - 1].x - fAniLength, ctrlPts[iCtrlPtCount - 1].y), ctrlPts[0], velocityVectors[iCtrlPtCount - 1], velocityVectors[0], ptvEvaluatedCurvePts, fAniLength);
-		displayC2(ctrlPts[iCtrlPtCount - 1], Point(ctrlPts[0].x + fAniLength, ctrlPts[0].y), velocityVectors[iCtrlPtCount - 1], velocityVectors[0], ptvEvaluatedCurvePts, fAniLength);
-
+		displayC2(Point(ptLast.x - fAniLength, ptLast.y), ptFirst, velocityVectors[iCtrlPtCount - 1], velocityVectors[0], ptvEvaluatedCurvePts, fAniLength);
 	}
 	
 	for (int i = 0; i + 1 < iCtrlPtCount; i++){
-			displayC2(ctrlPts[i], ctrlPts[i + 1], velocityVectors[i], velocityVectors[i + 1], ptvEvaluatedCurvePts, fAniLength);
+			displayC2(pptCtrlPts[i], pptCtrlPts[i + 1], velocityVectors[i], velocityVectors[i + 1], ptvEvaluatedCurvePts, fAniLength);
+	}
+
+	if (!bWrap){
+		ptvEvaluatedCurvePts.push_back(ptLast);
+		ptvEvaluatedCurvePts.push_back(Point(fAniLength, ptLast.y));
+	}
+	else{
+		displayC2(ptLast, Point(ptFirst.x + fAniLength, ptFirst.y), velocityVectors[iCtrlPtCount - 1], velocityVectors[0], ptvEvaluatedCurvePts, fAniLength);
 	}
 
+	// nothing is wrapped here (the wrap segments are clipped instead), but
+	// an interpolating segment may still overshoot backwards in x
+	scratch.ptvWrappedPts.clear();
+	mergeWrappedPoints(ptvEvaluatedCurvePts, scratch);
 }
 
 void C2InterpolationEvaluator::displayC2(Point c0, Point c1, Point d0, Point d1, std::vector<Point>& ptvEvaluatedCurvePts, float fAniLength) const{
-	Point v0(c0);
+	// hermite segment to bezier; the samples are clipped to the animation
 	Point v1(c0.x + d0.x / 3, c0.y + d0.y / 3);
 	Point v2(c1.x - d1.x / 3, c1.y - d1.y / 3);
-	Point v3(c1);
-	for (double u = 0; u < 1.0; u += 0.01){
-		Point v0Prime((1 - u)*v0.x + u*v1.x, (1 - u)*v0.y + u*v1.y);
-		Point v1Prime((1 - u)*v1.x + u*v2.x, (1 - u)*v1.y + u*v2.y);
-		Point v2Prime((1 - u)*v2.x + u*v3.x, (1 - u)*v2.y + u*v3.y);
-		Point v0DoublePrime((1 - u)*v0Prime.x + u*v1Prime.x, (1 - u)*v0Prime.y + u*v1Prime.y);
-		Point v1DoublePrime((1 - u)*v1Prime.x + u*v2Prime.x, (1 - u)*v1Prime.y + u*v2Prime.y);
-
-		double resultX = (1 - u)*v0DoublePrime.x + u*v1DoublePrime.x;
-		double resultY = (1 - u)*v0DoublePrime.y + u*v1DoublePrime.y;
-		if (resultX <= fAniLength && resultX >= 0){
-			Point result(resultX, resultY);
-			ptvEvaluatedCurvePts.push_back(result);
-		}
-	}
-
+	tessellateBezier(c0, v1, v2, c1, fAniLength, ptvEvaluatedCurvePts, NULL);
 }
 
-std::vector<Point> C2InterpolationEvaluator::calculateVelocity(std::vector<Point> ctrlPts, bool isWrap, double fAniLength) const{
-
-	const int ctrlPtCnt = ctrlPts.size();
-	double** matrix = new double*[ctrlPtCnt];
-	for (int i = 0; i < ctrlPtCnt; i++){
-		matrix[i] = new double[ctrlPtCnt];
+void C2InterpolationEvaluator::calculateVelocity(const Point* pptCtrlPts, const int iCtrlPtCount, bool isWrap, double fAniLength,
+												 CurveEvaluationScratch& scratch) const{
+
+	const int ctrlPtCnt = iCtrlPtCount;
+	std::vector<Point>& velocities = scratch.ptvVelocities;
+	velocities.assign(ctrlPtCnt, Point(0.0f, 0.0f));
+
+	if (ctrlPtCnt < 2)
+		return;
+
+	// The velocities D solve M D = R, where M has 1 4 1 on its inner rows.
+	// Its first and last rows are 2 1 and 1 2 for an open curve; when the
+	// curve wraps they are 4 1 with another 1 in the far corner, which
+	// makes the system cyclic. Both are solved in linear time with the
+	// Thomas algorithm, the cyclic one with a Sherman-Morrison correction.
+	const bool bCyclic = isWrap && ctrlPtCnt > 2;
+	const double endDiagonal = isWrap ? 4.0 : 2.0;
+	// Sherman-Morrison: M = M' + u v^T with u = (gamma, 0, ..., 0, 1) and
+	// v = (1, 0, ..., 0, 1 / gamma)
+	const double gamma = -endDiagonal;
+
+	std::vector<double>& upper = scratch.dvUpper;
+	std::vector<double>& velocityX = scratch.dvVelocityX;
+	std::vector<double>& velocityY = scratch.dvVelocityY;
+	std::vector<double>& correction = scratch.dvCorrection;
+	upper.resize(ctrlPtCnt);
+	velocityX.resize(ctrlPtCnt);
+	velocityY.resize(ctrlPtCnt);
+	correction.assign(ctrlPtCnt, 0.0);
+
+	//build right part of matrix
+	const int last = ctrlPtCnt - 1;
+	if (isWrap){
+		velocityX[0] = 3 * (pptCtrlPts[1].x - (pptCtrlPts[last].x - fAniLength));
+		velocityY[0] = 3 * (pptCtrlPts[1].y - pptCtrlPts[last].y);
+		velocityX[last] = 3 * (pptCtrlPts[0].x - (pptCtrlPts[last - 1].x - fAniLength));
+		velocityY[last] = 3 * (pptCtrlPts[0].y - pptCtrlPts[last - 1].y);
+	}
+	else{
+		velocityX[0] = 3 * (pptCtrlPts[1].x - pptCtrlPts[0].x);
+		velocityY[0] = 3 * (pptCtrlPts[1].y - pptCtrlPts[0].y);
+		velocityX[last] = 3 * (pptCtrlPts[last].x - pptCtrlPts[last - 1].x);
+		velocityY[last] = 3 * (pptCtrlPts[last].y - pptCtrlPts[last - 1].y);
+	}
+	for (int i = 1; i < last; i++){
+		velocityX[i] = 3 * (pptCtrlPts[i + 1].x - pptCtrlPts[i - 1].x);
+		velocityY[i] = 3 * (pptCtrlPts[i + 1].y - pptCtrlPts[i - 1].y);
+	}
+	if (bCyclic){
+		correction[0] = gamma;
+		correction[last] = 1.0;
 	}
 
-	if (ctrlPtCnt >= 2){
-		// initialize matrix start and end
-		if (isWrap){
-			matrix[0][0] = 4;
-			matrix[0][1] = 1;
-			matrix[0][ctrlPtCnt - 1] = 1;
-			matrix[ctrlPtCnt - 1][ctrlPtCnt - 2] = 1;
-			matrix[ctrlPtCnt - 1][ctrlPtCnt - 1] = 4;
-			matrix[ctrlPtCnt - 1][0] = 1;
-		}
-		else{
-
-			matrix[0][0] = 2;
-			matrix[0][1] = 1;
-			matrix[ctrlPtCnt - 1][ctrlPtCnt - 2] = 1;
-			matrix[ctrlPtCnt - 1][ctrlPtCnt - 1] = 2;
-		}
-
-
-		// initialize middle of the matrix
-		for (int i = 1; i < ctrlPtCnt - 1; i++){
-			matrix[i][i - 1] = 1;
-			matrix[i][i] = 4;
-			matrix[i][i + 1] = 1;
-		}
-
-		//build right part of matrix
-		std::vector<Point> rightPartOfMatrix;
-		rightPartOfMatrix.clear();
-		if (isWrap){
-			rightPartOfMatrix.push_back(Point(3 * (ctrlPts[1].x - (ctrlPts[ctrlPtCnt-1].x - fAniLength)), 3 * (ctrlPts[1].y - ctrlPts[ctrlPtCnt-1].y)));
-		}
-		else{
-			rightPartOfMatrix.push_back(Point(3 * (ctrlPts[1].x - ctrlPts[0].x), 3 * (ctrlPts[1].y - ctrlPts[0].y)));
-		}
-		
-		for (int i = 1; i < ctrlPtCnt-1; i++){
-			rightPartOfMatrix.push_back(Point(3 * (ctrlPts[i+1].x - ctrlPts[i-1].x), 3 * (ctrlPts[i+1].y - ctrlPts[i-1].y)));
-		}
-
-		if (isWrap){
-			rightPartOfMatrix.push_back(Point(3 * (ctrlPts[0].x - (ctrlPts[ctrlPtCnt - 2].x-fAniLength)), 3 * (ctrlPts[0].y - ctrlPts[ctrlPtCnt - 2].y)));
+	// forward sweep; every off-diagonal entry is 1
+	for (int i = 0; i <= last; i++){
+		double diagonal = (i == 0 || i == last) ? endDiagonal : 4.0;
+		if (bCyclic){
+			if (i == 0)
+				diagonal -= gamma;
+			else if (i == last)
+				diagonal -= 1.0 / gamma;
 		}
-		else{
-			rightPartOfMatrix.push_back(Point(3 * (ctrlPts[ctrlPtCnt - 1].x - ctrlPts[ctrlPtCnt - 2].x), 3 * (ctrlPts[ctrlPtCnt - 1].y - ctrlPts[ctrlPtCnt - 2].y)));
-		}
-
-		// build upper triangle matrix
-		for (int i = 0; i < ctrlPtCnt; i++){
-			double multiplyingFactor = 1.0 / matrix[i][i];
-			for (int j = 0; j < ctrlPtCnt; j++){
-				matrix[i][j] *= multiplyingFactor;
-				for (int k = i + 1; k < ctrlPtCnt; k++){
-					matrix[k][j] -= matrix[i][j] * matrix[k][i];
-				}
-
-			}
-
-			rightPartOfMatrix[i].x *= multiplyingFactor;
-			rightPartOfMatrix[i].y *= multiplyingFactor;
-
-			for (int k = i + 1; k < ctrlPtCnt; k++){
-
-				rightPartOfMatrix[k].x -= rightPartOfMatrix[i].x * matrix[k][i];
-				rightPartOfMatrix[k].y -= rightPartOfMatrix[i].y * matrix[k][i];
-			}
-
+		if (i > 0){
+			diagonal -= upper[i - 1];
+			velocityX[i] -= velocityX[i - 1];
+			velocityY[i] -= velocityY[i - 1];
+			correction[i] -= correction[i - 1];
 		}
-		
-		// build diagonal matrix
-		for (int i = ctrlPtCnt - 1; i > 0; i--){
-			double multiplyingFactor = matrix[i-1][i];
-			for (int j = 0; j < ctrlPtCnt; j++){
-
-				for (int k = i - 1; k >= 0; k--){
-					matrix[k][j] -= matrix[i][j] * matrix[k][i];
-				}
-			}
-
-			for (int k = i - 1; k >= 0; k--){
-				rightPartOfMatrix[k].x -= rightPartOfMatrix[i].x * matrix[k][i];
-				rightPartOfMatrix[k].y -= rightPartOfMatrix[i].y * matrix[k][i];
-			}
+		upper[i] = 1.0 / diagonal;
+		velocityX[i] /= diagonal;
+		velocityY[i] /= diagonal;
+		correction[i] /= diagonal;
+	}
 
-		}
+	// back substitution
+	for (int i = last - 1; i >= 0; i--){
+		velocityX[i] -= upper[i] * velocityX[i + 1];
+		velocityY[i] -= upper[i] * velocityY[i + 1];
+		correction[i] -= upper[i] * correction[i + 1];
+	}
 
-		// delete the matrix
-		for (int i = 0; i < ctrlPtCnt; i++) {
-			delete[] matrix[i];
-		}
-		delete[] matrix;
+	double factorX = 0.0;
+	double factorY = 0.0;
+	if (bCyclic){
+		double denominator = 1.0 + correction[0] + correction[last] / gamma;
+		factorX = (velocityX[0] + velocityX[last] / gamma) / denominator;
+		factorY = (velocityY[0] + velocityY[last] / gamma) / denominator;
+	}
 
-		return rightPartOfMatrix;
-		
+	for (int i = 0; i <= last; i++){
+		velocities[i] = Point(velocityX[i] - factorX * correction[i], velocityY[i] - factorY * correction[i]);
 	}
 }
\ No newline at end of file
@@ -10,12 +10,16 @@
 class C2InterpolationEvaluator : public CurveEvaluator
 {
 public:
-	void evaluateCurve(const std::vector<Point>& ptvCtrlPts,
+	void evaluateCurve(const Point* pptCtrlPts,
+		const int iCtrlPtCount,
 		std::vector<Point>& ptvEvaluatedCurvePts,
 		const float& fAniLength,
-		const bool& bWrap) const;
+		const bool& bWrap,
+		CurveEvaluationScratch& scratch) const;
 	void displayC2(Point c0, Point c1, Point d0, Point d1, std::vector<Point>& ptvEvaluatedCurvePts, float fAniLength) const;
-	std::vector<Point> calculateVelocity(std::vector<Point> ctrlPts, bool isWrap, double fAniLength) const;
+	// solves for the velocity at each control point, into scratch.ptvVelocities
+	void calculateVelocity(const Point* pptCtrlPts, const int iCtrlPtCount, bool isWrap, double fAniLength,
+		CurveEvaluationScratch& scratch) const;
 };
 
 #endif
\ No newline at end of file
@@ -2,11 +2,10 @@
 #include <Fl/gl.h>
 #include <gl/glu.h>
 #include <fstream>
+#include <cstdio>
 
 #include "Camera.h"
-#include "Curve.h"
-#include "CurveEvaluator.h"
-#include "LinearCurveEvaluator.h"
+#include "textscanner.h"
 
 #pragma warning(push)
 #pragma warning(disable : 4244)
@@ -19,6 +18,8 @@ const float kMouseRotationSensitivity		= 1.0f/90.0f;
 const float kMouseTranslationXSensitivity	= 0.03f;
 const float kMouseTranslationYSensitivity	= 0.03f;
 const float kMouseZoomSensitivity			= 0.08f;
+// the keyframe edits that can be undone
+const int kJournalCapacity					= 1024;
 
 void MakeDiagonal(Mat4f &m, float k)
 {
@@ -108,35 +109,47 @@ void MakeCamTrans(Mat4f &m, Vec3f &eye,
 
 void Camera::calculateViewingTransformParameters() 
 {
-	// compute new transformation based on
-	// user interaction
-	Mat4f dollyXform;
-	Mat4f azimXform;
-	Mat4f elevXform;
-	Mat4f twistXform;
-	Mat4f originXform;
-
-	Vec3f upVector;
-
-	MakeHTrans(dollyXform, Vec3f(0,0,mDolly));
-	MakeHRotY(azimXform, mAzimuth);
-	MakeHRotX(elevXform, mElevation);
-	MakeDiagonal(twistXform, 1.0f);
-	MakeHTrans(originXform, mLookAt);
-	
-	mPosition = Vec3f(0,0,0);
-
-	mPosition = originXform * (azimXform * (elevXform * (dollyXform * mPosition)));
+	// the eye is the look at point plus the dolly offset rotated by the
+	// elevation about x and then by the azimuth about y, written out
+	// instead of multiplying the four matrices
+	float sinAzim = sin(mAzimuth), cosAzim = cos(mAzimuth);
+	float sinElev = sin(mElevation), cosElev = cos(mElevation);
+
+	mPosition = mLookAt + Vec3f(sinAzim * cosElev * mDolly, -sinElev * mDolly, cosAzim * cosElev * mDolly);
 
 	if ( fmod(double(mElevation), 2.0*M_PI) < -M_PI/2 || fmod(double(mElevation), 2.0*M_PI) > M_PI/2 )
 		mUpVector= Vec3f(0,-1,0);
 	else
 		mUpVector= Vec3f(0,1,0);
 
+	// the same basis gluLookAt builds
+	Vec3f f = mLookAt - mPosition;
+	f.normalize();
+	Vec3f s = f ^ mUpVector;
+	s.normalize();
+	Vec3f u = s ^ f;
+
+	mViewingTransform = Mat4f(
+		 s[0],  s[1],  s[2], -(s * mPosition),
+		 u[0],  u[1],  u[2], -(u * mPosition),
+		-f[0], -f[1], -f[2],  (f * mPosition),
+		 0,     0,     0,     1);
+
+	// a rotation and a translation, so the inverse is the transposed
+	// rotation and the eye position
+	mInverseViewingTransform = Mat4f(
+		s[0], u[0], -f[0], mPosition[0],
+		s[1], u[1], -f[1], mPosition[1],
+		s[2], u[2], -f[2], mPosition[2],
+		0,    0,     0,    1);
+
+	mViewingTransform.getGLMatrix(mGLViewingTransform);
+
 	mDirtyTransform = false;
 }
 
-Camera::Camera() 
+Camera::Camera() :
+	mJournal(kJournalCapacity)
 {
 	mAzimuth = mTwist = 0.0f;
 	mElevation = 0.7f;
@@ -147,38 +160,8 @@ Camera::Camera()
 	mCurrentMouseAction = kActionNone;
 
 	m_bSnapped = false;
-	for (int i=AZIMUTH; i<NUM_KEY_CURVES; i++)
-		mKeyframes[i] = NULL;
 
 	calculateViewingTransformParameters();
-
-	mNumKeyframes = 0;
-}
-
-void Camera::createCurves(float t, float maxX)
-{
-	mKeyframes[AZIMUTH] = new Curve(maxX, Point(t, mAzimuth));
-	mKeyframes[AZIMUTH]->setEvaluator(new LinearCurveEvaluator());
-	mKeyframes[ELEVATION] = new Curve(maxX, Point(t, mElevation));
-	mKeyframes[ELEVATION]->setEvaluator(new LinearCurveEvaluator());
-	mKeyframes[DOLLY] = new Curve(maxX, Point(t, mDolly));
-	mKeyframes[DOLLY]->setEvaluator(new LinearCurveEvaluator());
-	mKeyframes[LOOKAT_X] = new Curve(maxX, Point(t, mLookAt[0]));
-	mKeyframes[LOOKAT_X]->setEvaluator(new LinearCurveEvaluator());
-	mKeyframes[LOOKAT_Y] = new Curve(maxX, Point(t, mLookAt[1]));
-	mKeyframes[LOOKAT_Y]->setEvaluator(new LinearCurveEvaluator());
-	mKeyframes[LOOKAT_Z] = new Curve(maxX, Point(t, mLookAt[2]));
-	mKeyframes[LOOKAT_Z]->setEvaluator(new LinearCurveEvaluator());
-}
-
-void Camera::deleteCurves()
-{
-	for (int i=AZIMUTH; i<NUM_KEY_CURVES; i++)  {
-		if (mKeyframes[i] != NULL) {
-			delete mKeyframes[i];
-			mKeyframes[i] = NULL;
-		}
-	}
 }
 
 void Camera::clickMouse( MouseAction_t action, int x, int y )
@@ -254,9 +237,21 @@ void Camera::applyViewingTransform() {
 
 	// Place the camera at mPosition, aim the camera at
 	// mLookAt, and twist the camera such that mUpVector is up
-	gluLookAt(	mPosition[0], mPosition[1], mPosition[2],
-				mLookAt[0],   mLookAt[1],   mLookAt[2],
-				mUpVector[0], mUpVector[1], mUpVector[2]);
+	glMultMatrixf(mGLViewingTransform);
+}
+
+const Mat4f& Camera::getViewingTransform()
+{
+	if( mDirtyTransform )
+		calculateViewingTransformParameters();
+	return mViewingTransform;
+}
+
+const Mat4f& Camera::getInverseViewingTransform()
+{
+	if( mDirtyTransform )
+		calculateViewingTransformParameters();
+	return mInverseViewingTransform;
 }
 
 
@@ -264,77 +259,113 @@ void Camera::applyViewingTransform() {
 void Camera::update(float t)
 {
 	// do nothing if no keyframes
-	if (mNumKeyframes == 0) 
+	if (mKeyframes.keyCount() == 0) 
 		return;
 
-	// otherwise, update based on curves
-	mAzimuth = mKeyframes[AZIMUTH]->evaluateCurveAt(t);
-	mElevation = mKeyframes[ELEVATION]->evaluateCurveAt(t);
-	mDolly = mKeyframes[DOLLY]->evaluateCurveAt(t);
-	mLookAt[0] = mKeyframes[LOOKAT_X]->evaluateCurveAt(t);
-	mLookAt[1] = mKeyframes[LOOKAT_Y]->evaluateCurveAt(t);
-	mLookAt[2] = mKeyframes[LOOKAT_Z]->evaluateCurveAt(t);
+	// otherwise, update based on the track
+	CameraPose cpPose;
+	mKeyframes.evaluate(t, cpPose);
+
+	mAzimuth = cpPose.fAzimuth;
+	mElevation = cpPose.fElevation;
+	mDolly = cpPose.fDolly;
+	mLookAt = cpPose.vecLookAt;
 
 	mDirtyTransform = true;
 }
 
 
+static EditDelta keyframeDelta(const int iKind, const CameraPose& cpKey)
+{
+	EditDelta edDelta;
+	edDelta.byKind = iKind;
+	edDelta.iTarget = 0;
+	edDelta.iIndex = 0;
+	edDelta.fvValues[0] = cpKey.fTime;
+	edDelta.fvValues[1] = cpKey.fAzimuth;
+	edDelta.fvValues[2] = cpKey.fElevation;
+	edDelta.fvValues[3] = cpKey.fDolly;
+	edDelta.fvValues[4] = cpKey.vecLookAt[0];
+	edDelta.fvValues[5] = cpKey.vecLookAt[1];
+	edDelta.fvValues[6] = cpKey.vecLookAt[2];
+	return edDelta;
+}
+
 bool Camera::setKeyframe(float t, float maxT)
 {
+	// replacing a keyframe is undone as one step
+	mJournal.beginStep();
+
 	if (m_bSnapped)
-		removeKeyframe(t);
+		removeClosestKeyframe(t);
 
-	if (mNumKeyframes == 0) {
-		// delete old curves
-		deleteCurves();
-		createCurves(t, maxT);
-		mNumKeyframes++;
-		return true;
-	}
+	if (mKeyframes.keyCount() == 0)
+		mKeyframes.maxTime(maxT);
 
-	// check if we're too close to a ctrl pt
-	double TIME_EPSILON = 0.01;
-	Point closestCtrlPt;
-	Point azimuthPt(t, mAzimuth);
-	mKeyframes[AZIMUTH]->getClosestControlPoint(azimuthPt, closestCtrlPt);
-	if (fabs(t - closestCtrlPt.x) <= TIME_EPSILON)
-		return false;
+	// don't add a keyframe too close to another one
+	const float TIME_EPSILON = 0.01f;
 
-	mKeyframes[AZIMUTH]->addControlPoint(Point(t, mAzimuth));
-	mKeyframes[ELEVATION]->addControlPoint(Point(t, mElevation));
-	mKeyframes[DOLLY]->addControlPoint(Point(t, mDolly));
-	mKeyframes[LOOKAT_X]->addControlPoint(Point(t, mLookAt[0]));
-	mKeyframes[LOOKAT_Y]->addControlPoint(Point(t, mLookAt[1]));
-	mKeyframes[LOOKAT_Z]->addControlPoint(Point(t, mLookAt[2]));
+	CameraPose cpKey;
+	cpKey.fTime = t;
+	cpKey.fAzimuth = mAzimuth;
+	cpKey.fElevation = mElevation;
+	cpKey.fDolly = mDolly;
+	cpKey.vecLookAt = mLookAt;
 
-	mNumKeyframes++;
+	if (!mKeyframes.setKey(cpKey, TIME_EPSILON))
+		return false;
 
+	mJournal.record(keyframeDelta(EditDelta::kInsertCameraKey, cpKey));
 	return true;
 }
 
 
 void Camera::removeKeyframe(float t)
 {
-	// check to see if there's something to remove
-	if (mNumKeyframes == 0) return;
-
-	Point tmp;
-	Point toRemove[NUM_KEY_CURVES];
-
-	toRemove[AZIMUTH] = Point(t, mAzimuth);
-	toRemove[ELEVATION] = Point(t, mElevation);
-	toRemove[DOLLY] = Point(t, mDolly);
-	toRemove[LOOKAT_X] = Point(t, mLookAt[0]);
-	toRemove[LOOKAT_Y] = Point(t, mLookAt[1]);
-	toRemove[LOOKAT_Z] = Point(t, mLookAt[2]);
-
-	for (int i=AZIMUTH; i<NUM_KEY_CURVES; i++) {
-		int j = mKeyframes[i]->getClosestControlPoint(toRemove[i], tmp);
-		mKeyframes[i]->removeControlPoint2(j);
-	}
+	mJournal.beginStep();
+	removeClosestKeyframe(t);
+}
+
+void Camera::removeClosestKeyframe(float t)
+{
+	int iKey = mKeyframes.closestKey(t);
+	if (iKey < 0)
+		return;
 
-	mNumKeyframes--;
+	mJournal.record(keyframeDelta(EditDelta::kRemoveCameraKey, mKeyframes.key(iKey)));
+	mKeyframes.removeKey(t);
+}
 
+bool Camera::undoKeyframeEdit()
+{
+	return mJournal.undo(applyJournalEdits, this);
+}
+
+bool Camera::redoKeyframeEdit()
+{
+	return mJournal.redo(applyJournalEdits, this);
+}
+
+void Camera::applyJournalEdits(const EditDelta* pedDeltas, const int iCount,
+							   const bool bUndo, void* pvCamera)
+{
+	CameraTrack& ctKeyframes = ((Camera*)pvCamera)->mKeyframes;
+
+	for (int i = 0; i < iCount; ++i) {
+		const float* pfValues = pedDeltas[i].fvValues;
+		CameraPose cpKey;
+		cpKey.fTime = pfValues[0];
+		cpKey.fAzimuth = pfValues[1];
+		cpKey.fElevation = pfValues[2];
+		cpKey.fDolly = pfValues[3];
+		cpKey.vecLookAt = Vec3f(pfValues[4], pfValues[5], pfValues[6]);
+
+		// undoing an insertion removes the keyframe, and the other way round
+		if ((pedDeltas[i].byKind == EditDelta::kInsertCameraKey) != bUndo)
+			ctKeyframes.setKey(cpKey, 0.0f);
+		else
+			ctKeyframes.removeKey(cpKey.fTime);
+	}
 }
 
 bool Camera::saveKeyframes(const char* szFileName) const
@@ -343,14 +374,7 @@ bool Camera::saveKeyframes(const char* szFileName) const
 
 	ofsFile.open(szFileName, std::ios::out);
 	if (!ofsFile.fail()) {
-		ofsFile << mNumKeyframes << std::endl;
-		ofsFile << NUM_KEY_CURVES << std::endl;
-
-		if (mKeyframes[0]) 
-			for (int i = 0; i < NUM_KEY_CURVES; ++i) {
-				mKeyframes[i]->toStream(ofsFile);
-			}
-
+		mKeyframes.toStream(ofsFile);
 		return true;
 	}
 
@@ -359,31 +383,17 @@ bool Camera::saveKeyframes(const char* szFileName) const
 
 bool Camera::loadKeyframes(const char* szFileName)
 {
-	std::ifstream ifsFile;
-
-	ifsFile.open(szFileName, std::ios::in);
-	if (!ifsFile.fail()) {
-		int iCurveCount;
-		int iNumKeyframes;
+	std::vector<char> cvText;
+	if (TextScanner::loadFile(szFileName, cvText) && !cvText.empty()) {
+		TextScanner tsScanner(&cvText[0], &cvText[0] + cvText.size());
 
-		ifsFile >> iNumKeyframes;
-		if (iNumKeyframes <= 0)
+		// the track is left as it was if the file is malformed
+		if (!mKeyframes.fromText(tsScanner)) {
+			fprintf(stderr, "%s: %s\n", szFileName, tsScanner.error().c_str());
 			return false;
-		mNumKeyframes = iNumKeyframes;
-
-		ifsFile >> iCurveCount;
-
-		if (iCurveCount != NUM_KEY_CURVES) {
-			return false;
-		}
-
-		deleteCurves();
-		createCurves(0.0f, 1.0f);
-
-		for (int i = 0; i < iCurveCount; ++i) {
-			mKeyframes[i]->fromStream(ifsFile);
 		}
 
+		mJournal.clear();
 		return true;
 	}
 
@@ -392,12 +402,7 @@ bool Camera::loadKeyframes(const char* szFileName)
 
 float Camera::keyframeTime(int keyframe) const
 {
-	if (mKeyframes[0]) {
-		Point ptCtrlPt;
-		mKeyframes[0]->getControlPoint(keyframe, ptCtrlPt);
-		return ptCtrlPt.x;
-	}
-	return 0.0f;
+	return mKeyframes.key(keyframe).fTime;
 }
 
 #pragma warning(pop)
\ No newline at end of file
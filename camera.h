@@ -7,19 +7,14 @@
 #include "mat.h"
 #include "rect.h"
 #include "point.h"
-#include "curve.h"
-#include "curveevaluator.h"
+#include "cameratrack.h"
+#include "editjournal.h"
 #include <vector>
 
 //==========[ class Camera ]===================================================
 
 typedef enum { kActionNone, kActionTranslate, kActionRotate, kActionZoom, kActionTwist,} MouseAction_t;
 
-enum KeyframeCurves
-{ 
-    AZIMUTH=0, ELEVATION, DOLLY, LOOKAT_X, LOOKAT_Y, LOOKAT_Z, NUM_KEY_CURVES 
-};
-
 class Camera {
     
 protected:
@@ -34,14 +29,25 @@ protected:
     Vec3f		mPosition;
     Vec3f		mUpVector;
     bool		mDirtyTransform;
+
+	// the look at matrix applyViewingTransform multiplies in, as a row
+	// major matrix, its inverse and in the column order of gl
+	Mat4f		mViewingTransform;
+	Mat4f		mInverseViewingTransform;
+	float		mGLViewingTransform[16];
     
     void calculateViewingTransformParameters();
     
     Vec3f			mLastMousePosition;
     MouseAction_t	mCurrentMouseAction;
 
-	Curve *			mKeyframes[NUM_KEY_CURVES];
-	int				mNumKeyframes;
+	CameraTrack		mKeyframes;
+	// the undo history of the keyframe edits
+	EditJournal		mJournal;
+
+	void removeClosestKeyframe(float t);
+	static void applyJournalEdits(const EditDelta* pedDeltas, const int iCount,
+		const bool bUndo, void* pvCamera);
     
     
 public:
@@ -94,16 +100,22 @@ public:
     //---[ Viewing Transform ]--------------------------------
     void applyViewingTransform();
 
+	// the world to eye transform and the eye to world transform, kept
+	// until the camera moves
+	const Mat4f& getViewingTransform();
+	const Mat4f& getInverseViewingTransform();
+
 	//---[ Animation ]-------------------------------------
-	void createCurves(float t, float maxX);
-	void deleteCurves();
 	void update(float t);
 	bool setKeyframe(float t, float maxT);
 	void removeKeyframe(float t);
 	bool m_bSnapped;
+	// undo and redo the last keyframe edit; false if there is none
+	bool undoKeyframeEdit();
+	bool redoKeyframeEdit();
 
 	int numKeyframes() const 
-	{ return mNumKeyframes; }
+	{ return mKeyframes.keyCount(); }
 
 	//---[ Save/Load Kerframes ]------------------------------
 	bool saveKeyframes(const char* szFileName) const;
@@ -0,0 +1,242 @@
+#include "cameratrack.h"
+#include "curve.h"
+#include "linearcurveevaluator.h"
+#include "textscanner.h"
+
+#include <math.h>
+#include <algorithm>
+#ifdef _DEBUG
+#include <assert.h>
+#endif // _DEBUG
+
+#ifndef M_PI
+#define M_PI 3.141592653589793238462643383279502f
+#endif
+
+// the azimuth, elevation, dolly and look at x, y, z curves of a .cam file
+static const int k_iChannelCount = 6;
+// segment table entries per keyframe
+static const int k_iBucketsPerKey = 4;
+
+// brings an angle into (-pi, pi]
+static inline float wrapAngle(float fAngle)
+{
+	fAngle = fmod(fAngle, 2.0f * M_PI);
+	if (fAngle > M_PI)
+		fAngle -= 2.0f * M_PI;
+	else if (fAngle <= -M_PI)
+		fAngle += 2.0f * M_PI;
+	return fAngle;
+}
+
+static inline bool keyBefore(const CameraPose& cpKey, float fTime)
+{
+	return cpKey.fTime < fTime;
+}
+
+static inline float channel(const CameraPose& cpPose, int iChannel)
+{
+	switch (iChannel) {
+	case 0: return cpPose.fAzimuth;
+	case 1: return cpPose.fElevation;
+	case 2: return cpPose.fDolly;
+	default: return cpPose.vecLookAt[iChannel - 3];
+	}
+}
+
+static inline void channel(CameraPose& cpPose, int iChannel, float fValue)
+{
+	switch (iChannel) {
+	case 0: cpPose.fAzimuth = fValue; break;
+	case 1: cpPose.fElevation = fValue; break;
+	case 2: cpPose.fDolly = fValue; break;
+	default: cpPose.vecLookAt[iChannel - 3] = fValue; break;
+	}
+}
+
+CameraTrack::CameraTrack() :
+	m_fMaxTime(1.0f),
+	m_fBucketsPerTime(0.0f),
+	m_bDirty(true)
+{
+}
+
+void CameraTrack::clear()
+{
+	m_cpvKeys.clear();
+	m_bDirty = true;
+}
+
+bool CameraTrack::setKey(const CameraPose& cpKey, float fEpsilon)
+{
+	std::vector<CameraPose>::iterator it = std::lower_bound(m_cpvKeys.begin(), m_cpvKeys.end(),
+		cpKey.fTime, keyBefore);
+
+	if ((it != m_cpvKeys.end() && it->fTime - cpKey.fTime <= fEpsilon) ||
+		(it != m_cpvKeys.begin() && cpKey.fTime - (it - 1)->fTime <= fEpsilon))
+		return false;
+
+	m_cpvKeys.insert(it, cpKey);
+	m_bDirty = true;
+	return true;
+}
+
+int CameraTrack::closestKey(float fTime) const
+{
+	if (m_cpvKeys.empty())
+		return -1;
+
+	std::vector<CameraPose>::const_iterator it = std::lower_bound(m_cpvKeys.begin(), m_cpvKeys.end(),
+		fTime, keyBefore);
+	if (it == m_cpvKeys.end() ||
+		(it != m_cpvKeys.begin() && fTime - (it - 1)->fTime < it->fTime - fTime))
+		--it;
+
+	return it - m_cpvKeys.begin();
+}
+
+void CameraTrack::removeKey(float fTime)
+{
+	if (m_cpvKeys.empty())
+		return;
+
+	m_cpvKeys.erase(m_cpvKeys.begin() + closestKey(fTime));
+	m_bDirty = true;
+}
+
+void CameraTrack::rebuild() const
+{
+	m_cpvUnwrapped = m_cpvKeys;
+	for (int i = 1; i < keyCount(); ++i) {
+		m_cpvUnwrapped[i].fAzimuth = m_cpvUnwrapped[i - 1].fAzimuth +
+			wrapAngle(m_cpvKeys[i].fAzimuth - m_cpvKeys[i - 1].fAzimuth);
+		m_cpvUnwrapped[i].fElevation = m_cpvUnwrapped[i - 1].fElevation +
+			wrapAngle(m_cpvKeys[i].fElevation - m_cpvKeys[i - 1].fElevation);
+	}
+
+	m_ivSegments.clear();
+	m_fBucketsPerTime = 0.0f;
+	if (keyCount() >= 2) {
+		float fFirstTime = m_cpvKeys.front().fTime;
+		float fSpan = m_cpvKeys.back().fTime - fFirstTime;
+		int iBuckets = k_iBucketsPerKey * keyCount();
+		m_fBucketsPerTime = iBuckets / fSpan;
+
+		m_ivSegments.resize(iBuckets);
+		int iKey = 0;
+		for (int iBucket = 0; iBucket < iBuckets; ++iBucket) {
+			float fBucketTime = fFirstTime + iBucket / m_fBucketsPerTime;
+			while (iKey + 2 < keyCount() && m_cpvKeys[iKey + 1].fTime <= fBucketTime)
+				++iKey;
+			m_ivSegments[iBucket] = iKey;
+		}
+	}
+
+	m_bDirty = false;
+}
+
+void CameraTrack::evaluate(float fTime, CameraPose& cpPose) const
+{
+#ifdef _DEBUG
+	assert(!m_cpvKeys.empty());
+#endif // _DEBUG
+
+	if (m_bDirty)
+		rebuild();
+
+	int iLast = keyCount() - 1;
+	if (fTime <= m_cpvUnwrapped[0].fTime)
+		cpPose = m_cpvUnwrapped[0];
+	else if (fTime >= m_cpvUnwrapped[iLast].fTime)
+		cpPose = m_cpvUnwrapped[iLast];
+	else {
+		int iBucket = (int)((fTime - m_cpvUnwrapped[0].fTime) * m_fBucketsPerTime);
+		iBucket = std::min(std::max(iBucket, 0), (int)m_ivSegments.size() - 1);
+
+		// the table gives the segment at the start of the bucket; the
+		// time may be a few keys further on, or before it by rounding
+		int iKey = m_ivSegments[iBucket];
+		while (m_cpvUnwrapped[iKey + 1].fTime <= fTime)
+			++iKey;
+		while (iKey > 0 && m_cpvUnwrapped[iKey].fTime > fTime)
+			--iKey;
+
+		const CameraPose& cp0 = m_cpvUnwrapped[iKey];
+		const CameraPose& cp1 = m_cpvUnwrapped[iKey + 1];
+		float s = (fTime - cp0.fTime) / (cp1.fTime - cp0.fTime);
+		cpPose.fAzimuth = cp0.fAzimuth + s * (cp1.fAzimuth - cp0.fAzimuth);
+		cpPose.fElevation = cp0.fElevation + s * (cp1.fElevation - cp0.fElevation);
+		cpPose.fDolly = cp0.fDolly + s * (cp1.fDolly - cp0.fDolly);
+		for (int i = 0; i < 3; ++i)
+			cpPose.vecLookAt[i] = cp0.vecLookAt[i] + s * (cp1.vecLookAt[i] - cp0.vecLookAt[i]);
+	}
+
+	cpPose.fTime = fTime;
+	cpPose.fAzimuth = wrapAngle(cpPose.fAzimuth);
+	cpPose.fElevation = wrapAngle(cpPose.fElevation);
+}
+
+void CameraTrack::toStream(std::ostream& osOutput) const
+{
+	osOutput << keyCount() << std::endl;
+	osOutput << k_iChannelCount << std::endl;
+
+	if (m_cpvKeys.empty())
+		return;
+
+	for (int iChannel = 0; iChannel < k_iChannelCount; ++iChannel) {
+		osOutput << keyCount() << std::endl;
+		for (int i = 0; i < keyCount(); ++i) {
+			osOutput << m_cpvKeys[i].fTime << std::endl;
+			osOutput << channel(m_cpvKeys[i], iChannel) << std::endl;
+		}
+		osOutput << m_fMaxTime << std::endl;
+		osOutput << false << std::endl;
+	}
+}
+
+bool CameraTrack::fromText(TextScanner& tsScanner)
+{
+	int iKeyCount;
+	int iChannelCount;
+
+	if (!tsScanner.readInt(iKeyCount) || iKeyCount <= 0) {
+		tsScanner.fail("a keyframe count");
+		return false;
+	}
+	if (!tsScanner.readInt(iChannelCount) || iChannelCount != k_iChannelCount) {
+		tsScanner.fail("6 keyframe curves");
+		return false;
+	}
+
+	LinearCurveEvaluator lceEvaluator;
+	Curve crvvChannels[k_iChannelCount];
+	for (int iChannel = 0; iChannel < k_iChannelCount; ++iChannel) {
+		if (!crvvChannels[iChannel].fromText(tsScanner))
+			return false;
+		if (crvvChannels[iChannel].controlPointCount() == 0) {
+			tsScanner.fail("a keyframe");
+			return false;
+		}
+		crvvChannels[iChannel].setEvaluator(&lceEvaluator);
+	}
+
+	// the keyframes are at the azimuth curve's control points. The other
+	// curves were edited alongside it and normally have the same times,
+	// but are sampled there in case they drifted apart.
+	const std::vector<Point>& ptvTimes = crvvChannels[0].controlPoints();
+	m_cpvKeys.resize(ptvTimes.size());
+	for (int i = 0; i < keyCount(); ++i) {
+		m_cpvKeys[i].fTime = ptvTimes[i].x;
+		for (int iChannel = 0; iChannel < k_iChannelCount; ++iChannel) {
+			const std::vector<Point>& ptvCtrlPts = crvvChannels[iChannel].controlPoints();
+			float fValue = (i < (int)ptvCtrlPts.size() && ptvCtrlPts[i].x == ptvTimes[i].x) ?
+				ptvCtrlPts[i].y : crvvChannels[iChannel].evaluateCurveAt(ptvTimes[i].x);
+			channel(m_cpvKeys[i], iChannel, fValue);
+		}
+	}
+	m_fMaxTime = crvvChannels[0].maxX();
+	m_bDirty = true;
+
+	return true;
+}
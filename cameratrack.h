@@ -0,0 +1,75 @@
+#ifndef CAMERATRACK_H_INCLUDED
+#define CAMERATRACK_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+#include <iostream>
+
+#include "vec.h"
+
+class TextScanner;
+
+// Everything the camera's viewing transform is built from, at one time
+struct CameraPose
+{
+	float fTime;
+	float fAzimuth;
+	float fElevation;
+	float fDolly;
+	Vec3f vecLookAt;
+};
+
+// The camera keyframes, kept as one array of poses in time order so that
+// a keyframe is added or removed in a single place and a single
+// evaluation gives the whole pose.
+//
+// The poses are interpolated linearly, the azimuth and elevation along
+// the shorter way around the circle. Before the first and after the last
+// keyframe the track holds. A table of which keyframe starts the segment
+// under each of a number of evenly spaced times is rebuilt after edits,
+// so evaluating does not search the keyframes.
+class CameraTrack
+{
+public:
+	CameraTrack();
+
+	void clear();
+	int keyCount() const { return (int)m_cpvKeys.size(); }
+	const CameraPose& key(int iKey) const { return m_cpvKeys[iKey]; }
+
+	// the animation length, kept for the file
+	float maxTime() const { return m_fMaxTime; }
+	void maxTime(float fMaxTime) { m_fMaxTime = fMaxTime; }
+
+	// false if there already is a keyframe within fEpsilon of its time
+	bool setKey(const CameraPose& cpKey, float fEpsilon);
+	// the keyframe closest in time, -1 if there is none
+	int closestKey(float fTime) const;
+	// removes the keyframe closest in time
+	void removeKey(float fTime);
+
+	// the angles come back within (-pi, pi]
+	void evaluate(float fTime, CameraPose& cpPose) const;
+
+	// The .cam format: the keyframe count, then a curve for each of the
+	// azimuth, elevation, dolly and the look at point's x, y and z as
+	// written by Curve::toStream.
+	void toStream(std::ostream& osOutput) const;
+	bool fromText(TextScanner& tsScanner);
+
+protected:
+	std::vector<CameraPose> m_cpvKeys;
+	float m_fMaxTime;
+
+	// the keys with the angles unwrapped, so that consecutive keys are
+	// less than pi apart, and the segment table
+	mutable std::vector<CameraPose> m_cpvUnwrapped;
+	mutable std::vector<int> m_ivSegments;
+	mutable float m_fBucketsPerTime;
+	mutable bool m_bDirty;
+
+	void rebuild() const;
+};
+
+#endif // CAMERATRACK_H_INCLUDED
@@ -10,12 +10,15 @@
 class CatmullRomEvaluator : public CurveEvaluator
 {
 public:
-	void evaluateCurve(const std::vector<Point>& ptvCtrlPts,
+	void evaluateCurve(const Point* pptCtrlPts,
+		const int iCtrlPtCount,
 		std::vector<Point>& ptvEvaluatedCurvePts,
 		const float& fAniLength,
-		const bool& bWrap) const;
-	void displayCatmullRom(Point v0, Point v1, Point v2, Point v3, std::vector<Point>& ptvEvaluatedCurvePts, float fAniLength) const;
-	std::vector<Point> convertToBezier(Point p0, Point p1, Point p2, Point p3) const;
+		const bool& bWrap,
+		CurveEvaluationScratch& scratch) const;
+	// writes the four bezier control points of the segment to pptBezier
+	void convertToBezier(const Point& p0, const Point& p1, const Point& p2, const Point& p3,
+		const double tension, Point* pptBezier) const;
 };
 
 #endif
\ No newline at end of file
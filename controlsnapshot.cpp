@@ -0,0 +1,125 @@
+#include "controlsnapshot.h"
+
+#include <thread>
+#ifdef _DEBUG
+#include <assert.h>
+#endif // _DEBUG
+
+ControlSnapshot::ControlSnapshot() :
+	m_pbWriting(&m_bvBuffers[0]),
+	m_pbPublished(NULL)
+{
+	for (int i = 0; i < 3; ++i) {
+		m_bvBuffers[i].iCount = 0;
+		m_bvBuffers[i].iReaders = 0;
+	}
+}
+
+float* ControlSnapshot::beginWrite(const int iCount)
+{
+#ifdef _DEBUG
+	assert(iCount >= 0);
+#endif // _DEBUG
+
+	// any buffer but the published one that no reader is in. A reader
+	// that got to a buffer just before it stopped being the published
+	// one sees that it no longer is, and leaves it without reading.
+	const Buffer* pbPublished = m_pbPublished.load();
+	for (int i = 0; ; i = (i + 1) % 3) {
+		Buffer* pbBuffer = &m_bvBuffers[i];
+		if (pbBuffer != pbPublished && pbBuffer->iReaders.load() == 0) {
+			m_pbWriting = pbBuffer;
+			break;
+		}
+		if (i == 2)
+			std::this_thread::yield();
+	}
+
+	if ((int)m_pbWriting->fvValues.size() < iCount)
+		m_pbWriting->fvValues.resize(iCount);
+	m_pbWriting->iCount = iCount;
+
+	return m_pbWriting->fvValues.empty() ? NULL : &m_pbWriting->fvValues[0];
+}
+
+void ControlSnapshot::publish()
+{
+	m_pbPublished.store(m_pbWriting);
+}
+
+const ControlSnapshot::Buffer* ControlSnapshot::acquire() const
+{
+	for (;;) {
+		const Buffer* pbBuffer = m_pbPublished.load();
+		if (pbBuffer == NULL)
+			return NULL;
+
+		// the buffer is safe to read if it is still the published one
+		// once the read is marked
+		++pbBuffer->iReaders;
+		if (m_pbPublished.load() == pbBuffer)
+			return pbBuffer;
+		--pbBuffer->iReaders;
+	}
+}
+
+void ControlSnapshot::release(const Buffer* pbBuffer) const
+{
+	if (pbBuffer != NULL)
+		--pbBuffer->iReaders;
+}
+
+float ControlSnapshot::value(const int iControl, const float fDefault) const
+{
+	const Buffer* pbBuffer = acquire();
+	float fValue = (pbBuffer != NULL && iControl >= 0 && iControl < pbBuffer->iCount) ?
+		pbBuffer->fvValues[iControl] : fDefault;
+	release(pbBuffer);
+
+	return fValue;
+}
+
+int ControlSnapshot::count() const
+{
+	const Buffer* pbBuffer = acquire();
+	int iCount = pbBuffer != NULL ? pbBuffer->iCount : 0;
+	release(pbBuffer);
+
+	return iCount;
+}
+
+ControlSnapshot::View::View() :
+	m_pcsSnapshot(NULL),
+	m_pbBuffer(NULL),
+	m_pfValues(NULL),
+	m_iCount(0)
+{
+}
+
+ControlSnapshot::View::~View()
+{
+	release();
+}
+
+void ControlSnapshot::View::acquire(const ControlSnapshot& csSnapshot)
+{
+	release();
+
+	m_pcsSnapshot = &csSnapshot;
+	m_pbBuffer = csSnapshot.acquire();
+	if (m_pbBuffer != NULL && m_pbBuffer->iCount > 0) {
+		m_pfValues = &m_pbBuffer->fvValues[0];
+		m_iCount = m_pbBuffer->iCount;
+	}
+}
+
+void ControlSnapshot::View::release()
+{
+	if (m_pcsSnapshot != NULL)
+		m_pcsSnapshot->release(m_pbBuffer);
+
+	m_pcsSnapshot = NULL;
+	m_pbBuffer = NULL;
+	m_pfValues = NULL;
+	m_iCount = 0;
+}
@@ -0,0 +1,81 @@
+#ifndef CONTROLSNAPSHOT_H_INCLUDED
+#define CONTROLSNAPSHOT_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+#include <atomic>
+#include <stddef.h>
+
+// The control values of one frame, copied out of the user interface into
+// a flat array. The writer fills a buffer of its own and then publishes
+// it, with its count, by a single pointer swap, so the drawing and the
+// curve evaluation read the values without touching the widgets. A
+// published snapshot is never changed. Readers on other threads mark the
+// buffer they read from for the length of the read, and the writer only
+// reuses a buffer no reader is in, so a read never sees a value of a
+// snapshot being written. There is a single writer, the UI thread.
+class ControlSnapshot
+{
+public:
+	ControlSnapshot();
+
+	// the buffer to fill for the next publish, with room for iCount
+	// values; waits for the readers still in it
+	float* beginWrite(const int iCount);
+	// makes the buffer filled since beginWrite the current snapshot
+	void publish();
+
+	// the value of a control in the current snapshot; fDefault before
+	// the first publish, or for a control the snapshot does not have
+	float value(const int iControl, const float fDefault) const;
+	// the number of values of the current snapshot
+	int count() const;
+
+protected:
+	struct Buffer
+	{
+		std::vector<float> fvValues;
+		int iCount;
+		// the reads going on in the buffer
+		mutable std::atomic<int> iReaders;
+	};
+
+	Buffer m_bvBuffers[3];
+	Buffer* m_pbWriting;
+	std::atomic<const Buffer*> m_pbPublished;
+
+	// the current snapshot, kept from being reused until release; NULL
+	// before the first publish
+	const Buffer* acquire() const;
+	void release(const Buffer* pbBuffer) const;
+
+public:
+	// The current snapshot held for a run of reads, such as all those of
+	// one draw, so that they take a single acquire and then index
+	// straight into the values. A view is used by one thread at a time.
+	class View
+	{
+	public:
+		View();
+		~View();
+
+		// holds the current snapshot; nothing is held before the first
+		// publish
+		void acquire(const ControlSnapshot& csSnapshot);
+		void release();
+		bool held() const { return m_pbBuffer != NULL; }
+
+		// the values of the snapshot held, count() of them
+		const float* values() const { return m_pfValues; }
+		int count() const { return m_iCount; }
+
+	protected:
+		const ControlSnapshot* m_pcsSnapshot;
+		const Buffer* m_pbBuffer;
+		const float* m_pfValues;
+		int m_iCount;
+	};
+};
+
+#endif // CONTROLSNAPSHOT_H_INCLUDED
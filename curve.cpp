@@ -14,13 +14,20 @@
 
 #include "Curve.h"
 #include "CurveEvaluator.h"
+#include "textscanner.h"
+#include "profiler.h"
 
 float Curve::s_fCtrlPtXEpsilon = 0.0001f;
+const int Curve::s_iCtrlPtBlockSize = 32;
 
 Curve::Curve() :
 	m_pceEvaluator(NULL),
 	m_bWrap(false),
 	m_bDirty(true),
+	m_iRevision(0),
+	m_iDrawRevision(-1),
+	m_iIndexRevision(-1),
+	m_bEditing(false),
 	m_fMaxX(1.0f)
 {
 	init();
@@ -30,6 +37,10 @@ Curve::Curve(const float fMaxX, const Point& point) :
 	m_pceEvaluator(NULL),
 	m_bWrap(false),
 	m_bDirty(true),
+	m_iRevision(0),
+	m_iDrawRevision(-1),
+	m_iIndexRevision(-1),
+	m_bEditing(false),
 	m_fMaxX(fMaxX)
 {
 	addControlPoint(point);
@@ -39,6 +50,10 @@ Curve::Curve(const float fMaxX, const float fStartYValue) :
 	m_pceEvaluator(NULL),
 	m_bWrap(false),
 	m_bDirty(true),
+	m_iRevision(0),
+	m_iDrawRevision(-1),
+	m_iIndexRevision(-1),
+	m_bEditing(false),
 	m_fMaxX(fMaxX)
 {
 	init(fStartYValue);
@@ -60,10 +75,15 @@ void Curve::maxX(const float fNewMaxX)
 		}
 	}
 
-	m_bDirty = true;
+	invalidate();
 }
 
-Curve::Curve(std::istream& isInputStream)
+Curve::Curve(std::istream& isInputStream) :
+	m_pceEvaluator(NULL),
+	m_iRevision(0),
+	m_iDrawRevision(-1),
+	m_iIndexRevision(-1),
+	m_bEditing(false)
 {
 	fromStream(isInputStream);
 }
@@ -97,13 +117,65 @@ void Curve::fromStream(std::istream& isInputStream)
 
 	isInputStream >> m_bWrap;
 
-	m_bDirty = true;
+	// the evaluators expect the control points in x order
+	sortControlPoints();
+
+	invalidate();
+}
+
+bool Curve::fromText(TextScanner& tsScanner)
+{
+	int iCtrlPtCount;
+
+	if (!tsScanner.readInt(iCtrlPtCount))
+		return false;
+	// the evaluators need a control point, and each point takes at least
+	// two digits and two separators, so a count the rest of the file
+	// cannot hold is rejected before anything is allocated
+	if (iCtrlPtCount < 1 || (size_t)iCtrlPtCount > tsScanner.remaining() / 4) {
+		tsScanner.fail("a control point count");
+		return false;
+	}
+
+	m_ptvCtrlPts.resize(iCtrlPtCount);
+
+	for (int iCtrlPt = 0; iCtrlPt < iCtrlPtCount; ++iCtrlPt) {
+		tsScanner.readFloat(m_ptvCtrlPts[iCtrlPt].x);
+		tsScanner.readFloat(m_ptvCtrlPts[iCtrlPt].y);
+	}
+
+	tsScanner.readFloat(m_fMaxX);
+
+	tsScanner.readBool(m_bWrap);
+
+	// the evaluators expect the control points in x order, which saved
+	// curves already are
+	if (!std::is_sorted(m_ptvCtrlPts.begin(), m_ptvCtrlPts.end(), PointSmallerXCompare()))
+		sortControlPoints();
+
+	invalidate();
+
+	return !tsScanner.failed();
+}
+
+void Curve::setControlPoints(const Point* pptCtrlPts, const int iCount,
+	const float fMaxX, const bool bWrap)
+{
+	m_ptvCtrlPts.assign(pptCtrlPts, pptCtrlPts + iCount);
+	m_fMaxX = fMaxX;
+	m_bWrap = bWrap;
+
+	// saved curves are already in order, so this is only a check
+	if (!std::is_sorted(m_ptvCtrlPts.begin(), m_ptvCtrlPts.end(), PointSmallerXCompare()))
+		sortControlPoints();
+
+	invalidate();
 }
 
 void Curve::wrap(bool bWrap)
 {
 	m_bWrap = bWrap;
-	m_bDirty = true;
+	invalidate();
 }
 
 bool Curve::wrap() const
@@ -114,15 +186,21 @@ bool Curve::wrap() const
 float Curve::evaluateCurveAt(const float x) const
 {
 	reevaluate();
-	
+
+	return evaluatePointsAt(m_ptvEvaluatedCurvePts.empty() ? NULL : &m_ptvEvaluatedCurvePts[0],
+		m_ptvEvaluatedCurvePts.size(), x);
+}
+
+float Curve::evaluatePointsAt(const Point* pptPts, const int iPtCount, const float x)
+{
 	float value = 0.0f;
 
-	if (m_ptvEvaluatedCurvePts.size() == 1)
-		return m_ptvEvaluatedCurvePts[0].y;
+	if (iPtCount == 1)
+		return pptPts[0].y;
 
-	if (m_ptvEvaluatedCurvePts.size() > 1) {
-		std::vector<Point>::iterator first_point = m_ptvEvaluatedCurvePts.begin();
-		std::vector<Point>::iterator last_point = m_ptvEvaluatedCurvePts.end() - 1;
+	if (iPtCount > 1) {
+		const Point* first_point = pptPts;
+		const Point* last_point = pptPts + iPtCount - 1;
 
 		bool evaluate_point_to_left_of_range = (first_point->x > x);
 		bool evaluate_point_to_right_of_range = (last_point->x < x);
@@ -134,35 +212,152 @@ float Curve::evaluateCurveAt(const float x) const
 			value = last_point->y;
 		}
 		else {
-			std::vector<Point>::iterator point_one_iterator = first_point;
-
-			while ((point_one_iterator + 1)->x < x) {
-				++point_one_iterator;
-#ifdef _DEBUG
-				assert(point_one_iterator != last_point);
-#endif // _DEBUG
-			}
-
-			std::vector<Point>::iterator point_two_iterator = point_one_iterator + 1;
+			// the evaluated points are sorted by x, so the segment can be
+			// found with a binary search: point_two is the first point
+			// (after the first one) that is not left of x
+			const Point* point_two_iterator = 
+				std::lower_bound(first_point + 1, last_point + 1,
+					Point(x, 0.0f), PointSmallerXCompare());
+			const Point* point_one_iterator = point_two_iterator - 1;
 			
 #ifdef _DEBUG
-			assert(point_one_iterator != m_ptvEvaluatedCurvePts.end());
-			assert(point_two_iterator != m_ptvEvaluatedCurvePts.end());
+			assert(point_two_iterator <= last_point);
 #endif // _DEBUG
 
-			Point point_one = *point_one_iterator;
-			Point point_two = *point_two_iterator;
+			value = interpolate(*point_one_iterator, *point_two_iterator, x);
+		}
+	}
+
+	return value;
+}
+
+void Curve::sampleRange(const float fStartX, const float fStepX, const int iCount, 
+						float* pfValues) const
+{
+	reevaluate();
+
+	if (iCount <= 0)
+		return;
+
+	// stepping backwards gets no benefit from the cursor below
+	if (m_ptvEvaluatedCurvePts.size() <= 1 || fStepX < 0.0f) {
+		for (int iSample = 0; iSample < iCount; ++iSample)
+			pfValues[iSample] = evaluateCurveAt(fStartX + iSample * fStepX);
+		return;
+	}
 
-			if (point_one.x == point_two.x)
+	const Point* pptPts = &m_ptvEvaluatedCurvePts[0];
+	const int iLastPt = m_ptvEvaluatedCurvePts.size() - 1;
+
+	int iSample = 0;
+
+	// samples left of the curve
+	for (; iSample < iCount && fStartX + iSample * fStepX < pptPts[0].x; ++iSample)
+		pfValues[iSample] = pptPts[0].y;
+
+	// the sample positions only increase, so the segment is found by moving
+	// a cursor forward instead of searching from scratch for every sample
+	int iPt = 0;
+	while (iSample < iCount) {
+		float x = fStartX + iSample * fStepX;
+		if (x > pptPts[iLastPt].x)
+			break;
+
+		while (pptPts[iPt + 1].x < x)
+			++iPt;
+
+		const Point& point_one = pptPts[iPt];
+		const Point& point_two = pptPts[iPt + 1];
+
+		if (point_one.x == point_two.x) {
+			pfValues[iSample++] = point_one.y;
+			continue;
+		}
+
+		// every following sample up to point_two lies on this segment
+		float slope = (point_two.y - point_one.y) / (point_two.x - point_one.x);
+		for (; iSample < iCount; ++iSample) {
+			x = fStartX + iSample * fStepX;
+			if (x > point_two.x)
+				break;
+			pfValues[iSample] = (x - point_one.x) * slope + point_one.y;
+		}
+	}
+
+	// samples right of the curve
+	for (; iSample < iCount; ++iSample)
+		pfValues[iSample] = pptPts[iLastPt].y;
+}
+
+void Curve::evaluateMany(const Curve* const* ppCurves, const int iCurveCount, 
+						 const float fStartX, const float fStepX, const int iCount, 
+						 float* pfValues)
+{
+	if (iCurveCount <= 0 || iCount <= 0)
+		return;
+
+	// stepping backwards gets no benefit from the cursors below
+	if (fStepX < 0.0f) {
+		for (int iSample = 0; iSample < iCount; ++iSample) {
+			const float x = fStartX + iSample * fStepX;
+			for (int iCurve = 0; iCurve < iCurveCount; ++iCurve)
+				*pfValues++ = ppCurves[iCurve]->evaluateCurveAt(x);
+		}
+		return;
+	}
+
+	// each curve is evaluated once up front and then keeps its own cursor
+	// into its evaluated points, which only moves forward as x increases
+	std::vector<int> ivCursors(iCurveCount, 0);
+	for (int iCurve = 0; iCurve < iCurveCount; ++iCurve)
+		ppCurves[iCurve]->reevaluate();
+
+	for (int iSample = 0; iSample < iCount; ++iSample) {
+		const float x = fStartX + iSample * fStepX;
+
+		for (int iCurve = 0; iCurve < iCurveCount; ++iCurve) {
+			const std::vector<Point>& ptvPts = ppCurves[iCurve]->m_ptvEvaluatedCurvePts;
+			float& value = *pfValues++;
+
+			if (ptvPts.size() <= 1) {
+				value = ptvPts.empty() ? 0.0f : ptvPts[0].y;
+				continue;
+			}
+			if (x < ptvPts.front().x) {
+				value = ptvPts.front().y;
+				continue;
+			}
+			if (x > ptvPts.back().x) {
+				value = ptvPts.back().y;
+				continue;
+			}
+
+			int& iPt = ivCursors[iCurve];
+			while (ptvPts[iPt + 1].x < x)
+				++iPt;
+
+			// the same arithmetic as sampleRange, so a curve gives the
+			// same values whichever of the two samples it
+			const Point& point_one = ptvPts[iPt];
+			const Point& point_two = ptvPts[iPt + 1];
+			if (point_one.x == point_two.x) {
 				value = point_one.y;
+			}
 			else {
 				float slope = (point_two.y - point_one.y) / (point_two.x - point_one.x);
 				value = (x - point_one.x) * slope + point_one.y;
 			}
 		}
 	}
+}
 
-	return value;
+float Curve::interpolate(const Point& point_one, const Point& point_two, const float x)
+{
+	if (point_one.x == point_two.x)
+		return point_one.y;
+
+	float slope = (point_two.y - point_one.y) / (point_two.x - point_one.x);
+	return (x - point_one.x) * slope + point_one.y;
 }
 
 void Curve::scaleX(const float fScale)
@@ -173,21 +368,237 @@ void Curve::scaleX(const float fScale)
 		control_point_iterator->x *= fScale;
 	}
 	m_fMaxX *= fScale;
-	m_bDirty = true;
+	invalidate();
 }
 
 void Curve::addControlPoint(const Point& point)
 {
-	m_ptvCtrlPts.push_back(point);
-	sortControlPoints();
-	m_bDirty = true;
+	// the control points are already in order, so the new one only has to
+	// go in the right place
+	m_ptvCtrlPts.insert(std::upper_bound(m_ptvCtrlPts.begin(), m_ptvCtrlPts.end(), 
+		point, PointSmallerXCompare()), point);
+	invalidate();
+}
+
+void Curve::beginEdit()
+{
+#ifdef _DEBUG
+	assert(!m_bEditing);
+#endif // _DEBUG
+
+	m_bEditing = true;
+}
+
+void Curve::insertMany(const Point* pptCtrlPts, const int iCount)
+{
+	bool bEditing = m_bEditing;
+	if (!bEditing)
+		beginEdit();
+
+	m_ptvEditInserts.insert(m_ptvEditInserts.end(), pptCtrlPts, pptCtrlPts + iCount);
+
+	if (!bEditing)
+		commit();
+}
+
+void Curve::removeMany(const int* piCtrlPts, const int iCount)
+{
+	bool bEditing = m_bEditing;
+	if (!bEditing)
+		beginEdit();
+
+	m_ivEditRemovals.insert(m_ivEditRemovals.end(), piCtrlPts, piCtrlPts + iCount);
+
+	if (!bEditing)
+		commit();
+}
+
+void Curve::commit()
+{
+#ifdef _DEBUG
+	assert(m_bEditing);
+#endif // _DEBUG
+
+	m_bEditing = false;
+
+	if (m_ptvEditInserts.empty() && m_ivEditRemovals.empty())
+		return;
+
+	std::sort(m_ivEditRemovals.begin(), m_ivEditRemovals.end());
+	std::stable_sort(m_ptvEditInserts.begin(), m_ptvEditInserts.end(), PointSmallerXCompare());
+
+	// merge the new points in while leaving out the removed ones. A new
+	// point goes after the control points with the same x, as it would
+	// with addControlPoint.
+	std::vector<Point> ptvMerged;
+	ptvMerged.reserve(m_ptvCtrlPts.size() + m_ptvEditInserts.size());
+
+	std::vector<int>::const_iterator itRemoval = m_ivEditRemovals.begin();
+	int iInsert = 0;
+	for (int i = 0; i < m_ptvCtrlPts.size(); ++i) {
+		while (itRemoval != m_ivEditRemovals.end() && *itRemoval < i)
+			++itRemoval;
+		if (itRemoval != m_ivEditRemovals.end() && *itRemoval == i)
+			continue;
+
+		while (iInsert < m_ptvEditInserts.size() && m_ptvEditInserts[iInsert].x < m_ptvCtrlPts[i].x)
+			ptvMerged.push_back(m_ptvEditInserts[iInsert++]);
+		ptvMerged.push_back(m_ptvCtrlPts[i]);
+	}
+	ptvMerged.insert(ptvMerged.end(), m_ptvEditInserts.begin() + iInsert, m_ptvEditInserts.end());
+
+	m_ptvCtrlPts.swap(ptvMerged);
+	m_ptvEditInserts.clear();
+	m_ivEditRemovals.clear();
+
+	invalidate();
+}
+
+int Curve::reduceKeys(const float fTolerance)
+{
+	std::vector<int> ivRemovals;
+	findReducibleKeys(fTolerance, ivRemovals);
+
+	if (!ivRemovals.empty())
+		removeMany(&ivRemovals[0], ivRemovals.size());
+
+	return ivRemovals.size();
+}
+
+void Curve::findReducibleKeys(const float fTolerance, std::vector<int>& ivCtrlPts) const
+{
+	ivCtrlPts.clear();
+
+	int iCtrlPtCount = m_ptvCtrlPts.size();
+	if (!m_pceEvaluator || iCtrlPtCount <= 2)
+		return;
+
+	// first keep only the control points the line between the kept ones
+	// misses by more than the tolerance (Ramer-Douglas-Peucker, with the
+	// distance taken in y)
+	std::vector<bool> bvKeep(iCtrlPtCount, false);
+	bvKeep[0] = true;
+	bvKeep[iCtrlPtCount - 1] = true;
+
+	std::vector<int> ivSpans;
+	ivSpans.push_back(0);
+	ivSpans.push_back(iCtrlPtCount - 1);
+	while (!ivSpans.empty()) {
+		int iLast = ivSpans.back();
+		ivSpans.pop_back();
+		int iFirst = ivSpans.back();
+		ivSpans.pop_back();
+
+		int iWorst = -1;
+		float fWorstError = fTolerance;
+		for (int i = iFirst + 1; i < iLast; ++i) {
+			float fError = fabs(m_ptvCtrlPts[i].y - 
+				interpolate(m_ptvCtrlPts[iFirst], m_ptvCtrlPts[iLast], m_ptvCtrlPts[i].x));
+			if (fError > fWorstError) {
+				iWorst = i;
+				fWorstError = fError;
+			}
+		}
+
+		if (iWorst >= 0) {
+			bvKeep[iWorst] = true;
+			ivSpans.push_back(iFirst);
+			ivSpans.push_back(iWorst);
+			ivSpans.push_back(iWorst);
+			ivSpans.push_back(iLast);
+		}
+	}
+
+	// That is exact only for linear curves. Evaluate the reduced curve with
+	// this curve's evaluator and, in every span between kept points where
+	// it is off by more than the tolerance, put back the removed point
+	// closest to where it is off the most, until it is within the
+	// tolerance everywhere. With every point back it is this curve again,
+	// so this ends.
+	reevaluate();
+
+	Curve crvReduced;
+	crvReduced.setEvaluator(m_pceEvaluator);
+
+	std::vector<Point> ptvKept;
+	std::vector<float> fvWorstError;
+	std::vector<float> fvWorstX;
+	int i;
+
+	for (;;) {
+		ptvKept.clear();
+		for (i = 0; i < iCtrlPtCount; ++i) {
+			if (bvKeep[i])
+				ptvKept.push_back(m_ptvCtrlPts[i]);
+		}
+		crvReduced.setControlPoints(&ptvKept[0], ptvKept.size(), m_fMaxX, m_bWrap);
+		crvReduced.reevaluate();
+
+		fvWorstError.assign(ptvKept.size() + 1, fTolerance);
+		fvWorstX.assign(ptvKept.size() + 1, 0.0f);
+
+		// both curves are lines between their evaluated points, so they are
+		// furthest apart at a point of one or the other
+		const std::vector<Point>& ptvReducedPts = crvReduced.m_ptvEvaluatedCurvePts;
+		int iSampleCount = m_ptvEvaluatedCurvePts.size() + ptvReducedPts.size();
+		for (int iSample = 0; iSample < iSampleCount; ++iSample) {
+			float x, fError;
+			if (iSample < m_ptvEvaluatedCurvePts.size()) {
+				x = m_ptvEvaluatedCurvePts[iSample].x;
+				fError = fabs(crvReduced.evaluateCurveAt(x) - m_ptvEvaluatedCurvePts[iSample].y);
+			}
+			else {
+				x = ptvReducedPts[iSample - m_ptvEvaluatedCurvePts.size()].x;
+				fError = fabs(evaluateCurveAt(x) - ptvReducedPts[iSample - m_ptvEvaluatedCurvePts.size()].y);
+			}
+
+			int iSpan = std::upper_bound(ptvKept.begin(), ptvKept.end(), 
+				Point(x, 0.0f), PointSmallerXCompare()) - ptvKept.begin();
+			if (fError > fvWorstError[iSpan]) {
+				fvWorstError[iSpan] = fError;
+				fvWorstX[iSpan] = x;
+			}
+		}
+
+		bool bRestored = false;
+		for (int iSpan = 0; iSpan < fvWorstError.size(); ++iSpan) {
+			if (fvWorstError[iSpan] <= fTolerance)
+				continue;
+
+			int iRight = std::lower_bound(m_ptvCtrlPts.begin(), m_ptvCtrlPts.end(), 
+				Point(fvWorstX[iSpan], 0.0f), PointSmallerXCompare()) - m_ptvCtrlPts.begin();
+			int iLeft = iRight - 1;
+			while (iLeft >= 0 && bvKeep[iLeft])
+				--iLeft;
+			while (iRight < iCtrlPtCount && bvKeep[iRight])
+				++iRight;
+
+			if (iLeft >= 0 && (iRight >= iCtrlPtCount || 
+				fvWorstX[iSpan] - m_ptvCtrlPts[iLeft].x < m_ptvCtrlPts[iRight].x - fvWorstX[iSpan])) {
+				bvKeep[iLeft] = true;
+				bRestored = true;
+			}
+			else if (iRight < iCtrlPtCount) {
+				bvKeep[iRight] = true;
+				bRestored = true;
+			}
+		}
+
+		if (!bRestored)
+			break;
+	}
+
+	for (i = 0; i < iCtrlPtCount; ++i) {
+		if (!bvKeep[i])
+			ivCtrlPts.push_back(i);
+	}
 }
 
 void Curve::removeControlPoint(const int iCtrlPt)
 {
 	if (iCtrlPt < m_ptvCtrlPts.size() && m_ptvCtrlPts.size() > 2) {
 		m_ptvCtrlPts.erase(m_ptvCtrlPts.begin() + iCtrlPt);
-		m_bDirty = true;
+		invalidate();
 	}
 }
 
@@ -196,7 +607,7 @@ void Curve::removeControlPoint2(const int iCtrlPt)
 {
 	if (iCtrlPt < m_ptvCtrlPts.size()) {
 		m_ptvCtrlPts.erase(m_ptvCtrlPts.begin() + iCtrlPt);
-		m_bDirty = true;
+		invalidate();
 	}
 }
 
@@ -204,23 +615,145 @@ int Curve::getClosestControlPoint(const Point& point, Point& ptCtrlPt) const
 {
 	reevaluate();
 
+	if (m_iIndexRevision != m_iRevision)
+		buildControlPointIndex();
+
 	int iMinDistPt = 0;
 	float fMinDistSquared = FLT_MAX;
+	int iBlockCount = m_fvBlockMinY.size();
+
+	if (iBlockCount == 0)
+		return iMinDistPt;
+
+	// search outwards from the block at point.x, in both directions until
+	// the blocks are further away in x alone than the closest point found
+	int iStartBlock = (std::lower_bound(m_ptvCtrlPts.begin(), m_ptvCtrlPts.end(), 
+		point, PointSmallerXCompare()) - m_ptvCtrlPts.begin()) / s_iCtrlPtBlockSize;
+	if (iStartBlock >= iBlockCount)
+		iStartBlock = iBlockCount - 1;
+
+	closestControlPointInBlock(iStartBlock, point, iMinDistPt, fMinDistSquared);
+
+	bool bLeft = true;
+	bool bRight = true;
+	for (int iStep = 1; bLeft || bRight; ++iStep) {
+		if (bLeft)
+			bLeft = iStartBlock - iStep >= 0 &&
+				closestControlPointInBlock(iStartBlock - iStep, point, iMinDistPt, fMinDistSquared);
+		if (bRight)
+			bRight = iStartBlock + iStep < iBlockCount &&
+				closestControlPointInBlock(iStartBlock + iStep, point, iMinDistPt, fMinDistSquared);
+	}
+
+	ptCtrlPt = m_ptvCtrlPts[iMinDistPt];
+
+	return iMinDistPt;
+}
 
-	for (int i = 0; i < m_ptvCtrlPts.size(); ++i) { 
-		float delta_x = (m_ptvCtrlPts[i].x - point.x);
-		float delta_y = (m_ptvCtrlPts[i].y - point.y);
+bool Curve::closestControlPointInBlock(const int iBlock, const Point& point, 
+									   int& iMinDistPt, float& fMinDistSquared) const
+{
+	int iBegin = iBlock * s_iCtrlPtBlockSize;
+	int iEnd = iBegin + s_iCtrlPtBlockSize;
+	if (iEnd > m_ptvCtrlPts.size())
+		iEnd = m_ptvCtrlPts.size();
+
+	// the distance to the box around the block's points, which none of
+	// them is closer than
+	float delta_x = 0.0f;
+	if (point.x < m_ptvCtrlPts[iBegin].x)
+		delta_x = m_ptvCtrlPts[iBegin].x - point.x;
+	else if (point.x > m_ptvCtrlPts[iEnd - 1].x)
+		delta_x = point.x - m_ptvCtrlPts[iEnd - 1].x;
+
+	float delta_y = 0.0f;
+	if (point.y < m_fvBlockMinY[iBlock])
+		delta_y = m_fvBlockMinY[iBlock] - point.y;
+	else if (point.y > m_fvBlockMaxY[iBlock])
+		delta_y = point.y - m_fvBlockMaxY[iBlock];
+
+	if (delta_x * delta_x > fMinDistSquared)
+		return false;
+	if (delta_x * delta_x + delta_y * delta_y > fMinDistSquared)
+		return true;
+
+	for (int i = iBegin; i < iEnd; ++i) {
+		delta_x = (m_ptvCtrlPts[i].x - point.x);
+		delta_y = (m_ptvCtrlPts[i].y - point.y);
 
 		float fDistSquared = delta_x * delta_x + delta_y * delta_y;
 
-		if (fDistSquared < fMinDistSquared) {
+		// on a tie the first point wins, as with a scan in x order
+		if (fDistSquared < fMinDistSquared || 
+			(fDistSquared == fMinDistSquared && i < iMinDistPt)) {
 			iMinDistPt = i;
 			fMinDistSquared = fDistSquared;
-			ptCtrlPt = m_ptvCtrlPts[i];
 		}
 	}
 
-	return iMinDistPt;
+	return true;
+}
+
+void Curve::getControlPointsInBox(const Point& ptMin, const Point& ptMax,
+								  std::vector<int>& ivCtrlPts) const
+{
+	if (m_iIndexRevision != m_iRevision)
+		buildControlPointIndex();
+
+	int iBegin = std::lower_bound(m_ptvCtrlPts.begin(), m_ptvCtrlPts.end(), 
+		ptMin, PointSmallerXCompare()) - m_ptvCtrlPts.begin();
+	int iEnd = std::upper_bound(m_ptvCtrlPts.begin() + iBegin, m_ptvCtrlPts.end(), 
+		ptMax, PointSmallerXCompare()) - m_ptvCtrlPts.begin();
+
+	int iBlockEnd;
+	for (int i = iBegin; i < iEnd; i = iBlockEnd) {
+		int iBlock = i / s_iCtrlPtBlockSize;
+		iBlockEnd = (iBlock + 1) * s_iCtrlPtBlockSize;
+		if (iBlockEnd > iEnd)
+			iBlockEnd = iEnd;
+
+		// skip the blocks entirely above or below the box, and take the
+		// ones entirely inside it without looking at their points
+		if (m_fvBlockMaxY[iBlock] < ptMin.y || m_fvBlockMinY[iBlock] > ptMax.y)
+			continue;
+
+		bool bInside = m_fvBlockMinY[iBlock] >= ptMin.y && m_fvBlockMaxY[iBlock] <= ptMax.y;
+		for (int iCtrlPt = i; iCtrlPt < iBlockEnd; ++iCtrlPt) {
+			if (bInside || 
+				(m_ptvCtrlPts[iCtrlPt].y >= ptMin.y && m_ptvCtrlPts[iCtrlPt].y <= ptMax.y))
+				ivCtrlPts.push_back(iCtrlPt);
+		}
+	}
+}
+
+void Curve::buildControlPointIndex() const
+{
+	int iCtrlPtCount = m_ptvCtrlPts.size();
+	int iBlockCount = (iCtrlPtCount + s_iCtrlPtBlockSize - 1) / s_iCtrlPtBlockSize;
+
+	m_fvBlockMinY.resize(iBlockCount);
+	m_fvBlockMaxY.resize(iBlockCount);
+
+	for (int iBlock = 0; iBlock < iBlockCount; ++iBlock) {
+		int iBegin = iBlock * s_iCtrlPtBlockSize;
+		int iEnd = iBegin + s_iCtrlPtBlockSize;
+		if (iEnd > iCtrlPtCount)
+			iEnd = iCtrlPtCount;
+
+		float fMinY = m_ptvCtrlPts[iBegin].y;
+		float fMaxY = m_ptvCtrlPts[iBegin].y;
+		for (int i = iBegin + 1; i < iEnd; ++i) {
+			if (m_ptvCtrlPts[i].y < fMinY)
+				fMinY = m_ptvCtrlPts[i].y;
+			if (m_ptvCtrlPts[i].y > fMaxY)
+				fMaxY = m_ptvCtrlPts[i].y;
+		}
+
+		m_fvBlockMinY[iBlock] = fMinY;
+		m_fvBlockMaxY[iBlock] = fMaxY;
+	}
+
+	m_iIndexRevision = m_iRevision;
 }
 
 void Curve::getClosestPoint(const Point& pt, Point& ptClosestPt) const
@@ -285,27 +818,27 @@ void Curve::moveControlPoint(const int iCtrlPt, const Point& ptNewPt)
 		}
 	}
 
-	m_bDirty = true;
+	invalidate();
 }
 
-void Curve::moveControlPoints(const std::vector<int>& ivCtrlPts, const Point& ptOffset,
+void Curve::moveControlPoints(const std::unordered_set<int>& isCtrlPts, const Point& ptOffset,
 							  const float fMinY, const float fMaxY)
 {
 	int iCtrlPtCount = m_ptvCtrlPts.size();
 
 #ifdef _DEBUG
-	for (int iCheck = 0; iCheck < ivCtrlPts.size(); ++iCheck) {
-		assert(ivCtrlPts[iCheck] < iCtrlPtCount);
+	for (std::unordered_set<int>::const_iterator it = isCtrlPts.begin(); it != isCtrlPts.end(); ++it) {
+		assert(*it < iCtrlPtCount);
 	}
 #endif // _DEBUG
 
 	Point ptActualOffset = ptOffset;
-	int i;
+	std::unordered_set<int>::const_iterator it;
 
 	// make sure the will be moved points will not run over other
 	// static control points. Also limit the y value.
-	for (i = 0; i < ivCtrlPts.size(); ++i) {
-		int iCtrlPt = ivCtrlPts[i];
+	for (it = isCtrlPts.begin(); it != isCtrlPts.end(); ++it) {
+		int iCtrlPt = *it;
 
 		if (m_ptvCtrlPts[iCtrlPt].y + ptActualOffset.y > fMaxY)
 			ptActualOffset.y = fMaxY - m_ptvCtrlPts[iCtrlPt].y;
@@ -313,7 +846,7 @@ void Curve::moveControlPoints(const std::vector<int>& ivCtrlPts, const Point& pt
 			ptActualOffset.y = fMinY - m_ptvCtrlPts[iCtrlPt].y;
 
 		if (iCtrlPt > 0) {
-			if (std::find(ivCtrlPts.begin(), ivCtrlPts.end(), iCtrlPt - 1) == ivCtrlPts.end()) {
+			if (isCtrlPts.count(iCtrlPt - 1) == 0) {
 				if (m_ptvCtrlPts[iCtrlPt].x + ptActualOffset.x < m_ptvCtrlPts[iCtrlPt - 1].x + s_fCtrlPtXEpsilon)
 					ptActualOffset.x = m_ptvCtrlPts[iCtrlPt - 1].x + s_fCtrlPtXEpsilon - m_ptvCtrlPts[iCtrlPt].x;
 			}
@@ -324,7 +857,7 @@ void Curve::moveControlPoints(const std::vector<int>& ivCtrlPts, const Point& pt
 		}
 
 		if (iCtrlPt < iCtrlPtCount - 1) {
-			if (std::find(ivCtrlPts.begin(), ivCtrlPts.end(), iCtrlPt + 1) == ivCtrlPts.end()) {
+			if (isCtrlPts.count(iCtrlPt + 1) == 0) {
 				if (m_ptvCtrlPts[iCtrlPt].x + ptActualOffset.x > m_ptvCtrlPts[iCtrlPt + 1].x - s_fCtrlPtXEpsilon)
 					ptActualOffset.x = m_ptvCtrlPts[iCtrlPt + 1].x - s_fCtrlPtXEpsilon - m_ptvCtrlPts[iCtrlPt].x;
 			}
@@ -336,13 +869,13 @@ void Curve::moveControlPoints(const std::vector<int>& ivCtrlPts, const Point& pt
 	}
 
 	// move the control points
-	for (i = 0; i < ivCtrlPts.size(); ++i) {
-		int iCtrlPt = ivCtrlPts[i];
+	for (it = isCtrlPts.begin(); it != isCtrlPts.end(); ++it) {
+		int iCtrlPt = *it;
 		m_ptvCtrlPts[iCtrlPt].x += ptActualOffset.x;
 		m_ptvCtrlPts[iCtrlPt].y += ptActualOffset.y;
 	}
 
-	m_bDirty = true;
+	invalidate();
 }
 
 void Curve::drawCurve() const
@@ -367,6 +900,80 @@ void Curve::drawEvaluatedCurveSegments() const
 	glEnd();
 }
 
+void Curve::drawEvaluatedCurveSegments(const float fMinX, const float fMaxX, const int iColumns) const
+{
+	reevaluate();
+
+	// only rebuild the line when the curve or the view has changed
+	if (m_iDrawRevision != m_iRevision || m_fDrawMinX != fMinX || 
+		m_fDrawMaxX != fMaxX || m_iDrawColumns != iColumns) {
+		buildDrawPoints(fMinX, fMaxX, iColumns);
+		m_iDrawRevision = m_iRevision;
+		m_fDrawMinX = fMinX;
+		m_fDrawMaxX = fMaxX;
+		m_iDrawColumns = iColumns;
+	}
+
+	if (m_ptvDrawPts.empty())
+		return;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_FLOAT, sizeof(Point), &m_ptvDrawPts[0]);
+	glDrawArrays(GL_LINE_STRIP, 0, m_ptvDrawPts.size());
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void Curve::buildDrawPoints(const float fMinX, const float fMaxX, const int iColumns) const
+{
+	m_ptvDrawPts.clear();
+	if (m_ptvEvaluatedCurvePts.empty())
+		return;
+
+	const Point* pptPts = &m_ptvEvaluatedCurvePts[0];
+	const int iPtCount = m_ptvEvaluatedCurvePts.size();
+
+	// the visible points, and one more on each side so that the line
+	// runs off the edges of the view
+	int iBegin = std::lower_bound(pptPts, pptPts + iPtCount, Point(fMinX, 0.0f), 
+		PointSmallerXCompare()) - pptPts;
+	int iEnd = std::upper_bound(pptPts + iBegin, pptPts + iPtCount, Point(fMaxX, 0.0f), 
+		PointSmallerXCompare()) - pptPts;
+	if (iBegin > 0)
+		--iBegin;
+	if (iEnd < iPtCount)
+		++iEnd;
+
+	if (iEnd - iBegin <= 2 * iColumns || iColumns <= 0 || fMaxX <= fMinX) {
+		m_ptvDrawPts.assign(pptPts + iBegin, pptPts + iEnd);
+		return;
+	}
+
+	// more points than pixels: keep only the lowest and the highest point
+	// of each pixel column, which still shows every peak
+	float fColumnsPerX = iColumns / (fMaxX - fMinX);
+	int iLast = iEnd - 1;
+
+	m_ptvDrawPts.push_back(pptPts[iBegin]);
+	int i = iBegin + 1;
+	while (i < iLast) {
+		int iColumn = (int)((pptPts[i].x - fMinX) * fColumnsPerX);
+		int iMin = i;
+		int iMax = i;
+		for (++i; i < iLast && (int)((pptPts[i].x - fMinX) * fColumnsPerX) == iColumn; ++i) {
+			if (pptPts[i].y < pptPts[iMin].y)
+				iMin = i;
+			if (pptPts[i].y > pptPts[iMax].y)
+				iMax = i;
+		}
+
+		// in the order the curve passes them
+		m_ptvDrawPts.push_back(pptPts[iMin < iMax ? iMin : iMax]);
+		if (iMin != iMax)
+			m_ptvDrawPts.push_back(pptPts[iMin < iMax ? iMax : iMin]);
+	}
+	m_ptvDrawPts.push_back(pptPts[iLast]);
+}
+
 void Curve::drawControlPoint(int iCtrlPt) const
 {
 	reevaluate();
@@ -414,14 +1021,20 @@ void Curve::reevaluate() const
 {
 	if (m_bDirty) {
 		if (m_pceEvaluator) {
-			m_pceEvaluator->evaluateCurve(m_ptvCtrlPts, 
+			PROFILE_SCOPE("curve evaluation");
+			m_pceEvaluator->evaluateCurve(m_ptvCtrlPts.empty() ? NULL : &m_ptvCtrlPts[0],
+				m_ptvCtrlPts.size(),
 				m_ptvEvaluatedCurvePts, 
 				m_fMaxX, 
-				m_bWrap);
+				m_bWrap,
+				m_scratch);
 
-			std::sort(m_ptvEvaluatedCurvePts.begin(),
+			// the evaluators hand back points already ordered by x
+#ifdef _DEBUG
+			assert(std::is_sorted(m_ptvEvaluatedCurvePts.begin(),
 				m_ptvEvaluatedCurvePts.end(),
-				PointSmallerXCompare());
+				PointSmallerXCompare()));
+#endif // _DEBUG
 
 			m_bDirty = false;
 		}
@@ -431,6 +1044,7 @@ void Curve::reevaluate() const
 void Curve::invalidate() const
 {
 	m_bDirty = true;
+	++m_iRevision;
 }
 
 std::ostream& operator<<(std::ostream& output_stream, const Curve & curve_data)
@@ -6,10 +6,29 @@
 #include <vector>
 #include <iostream>
 #include <string>
+#include <unordered_set>
 
 #include "Point.h"
 
 class CurveEvaluator;
+class TextScanner;
+
+// Working storage the evaluators reuse between evaluations, so that
+// re-evaluating a curve does not allocate once the vectors have grown
+struct CurveEvaluationScratch
+{
+	// samples wrapped around to the front of the animation, and the
+	// storage they are merged into when they interleave with the rest
+	std::vector<Point> ptvWrappedPts;
+	std::vector<Point> ptvMergedPts;
+	// C2 interpolation: the velocity at each control point, and the
+	// storage for the tridiagonal solve that finds them
+	std::vector<Point> ptvVelocities;
+	std::vector<double> dvUpper;
+	std::vector<double> dvVelocityX;
+	std::vector<double> dvVelocityY;
+	std::vector<double> dvCorrection;
+};
 
 //using namespace std;
 
@@ -23,51 +42,138 @@ public:
 	Curve(std::istream& isInputStream);
 
 	void maxX(const float fNewMaxX);
-	void setEvaluator(const CurveEvaluator* pceEvaluator) { m_pceEvaluator = pceEvaluator; }
+	float maxX() const { return m_fMaxX; }
+	void setEvaluator(const CurveEvaluator* pceEvaluator) { m_pceEvaluator = pceEvaluator; invalidate(); }
 	float evaluateCurveAt(const float x) const;
+	// evaluates the line through points sorted by x, the way
+	// evaluateCurveAt does with the evaluated points
+	static float evaluatePointsAt(const Point* pptPts, const int iPtCount, const float x);
+	// the points the evaluator computed, sorted by x
+	const std::vector<Point>& evaluatedPoints() const {
+		reevaluate();
+		return m_ptvEvaluatedCurvePts;
+	}
+	// evaluates the curve at iCount evenly spaced x values starting at
+	// fStartX, much faster than calling evaluateCurveAt for each of them
+	void sampleRange(const float fStartX, const float fStepX, const int iCount, 
+		float* pfValues) const;
+	// evaluates all the curves at iCount evenly spaced x values starting at
+	// fStartX, like sampleRange does for one curve. The values are written
+	// x by x: pfValues[iSample * iCurveCount + iCurve].
+	static void evaluateMany(const Curve* const* ppCurves, const int iCurveCount, 
+		const float fStartX, const float fStepX, const int iCount, float* pfValues);
 	void scaleX(const float fScale);
 	void addControlPoint(const Point& point);
 	void removeControlPoint(const int iCtrlPt);
 	void removeControlPoint2(const int iCtrlPt);
+	// Bulk edits. Between beginEdit and commit, insertMany and removeMany
+	// only collect the changes, and commit applies them all with a single
+	// merge and a single invalidation. The indices given to removeMany are
+	// those of the control points when beginEdit was called; unlike
+	// removeControlPoint it can remove every point. Called outside an
+	// edit, insertMany and removeMany are applied at once.
+	void beginEdit();
+	void insertMany(const Point* pptCtrlPts, const int iCount);
+	void removeMany(const int* piCtrlPts, const int iCount);
+	void commit();
+	bool editing() const { return m_bEditing; }
+	// Removes control points while keeping the evaluated curve within
+	// fTolerance in y of where it was, checked with the curve's own
+	// evaluator. The first and last control points stay. Returns how many
+	// control points were removed.
+	int reduceKeys(const float fTolerance);
+	// the control points reduceKeys would remove, in order
+	void findReducibleKeys(const float fTolerance, std::vector<int>& ivCtrlPts) const;
 	void getControlPoint(const int iCtrlPt, Point& ptCtrlPt) const {
 		ptCtrlPt = m_ptvCtrlPts[iCtrlPt];
 	}
+	// puts a control point where it was without keeping it between its
+	// neighbours, for undoing edits
+	void setControlPoint(const int iCtrlPt, const Point& ptCtrlPt) {
+		m_ptvCtrlPts[iCtrlPt] = ptCtrlPt;
+		invalidate();
+	}
 	int getClosestControlPoint(const Point& point, Point& ptCtrlPt) const;
+	// adds the indices of the control points inside the box from ptMin to
+	// ptMax to ivCtrlPts, in x order
+	void getControlPointsInBox(const Point& ptMin, const Point& ptMax,
+		std::vector<int>& ivCtrlPts) const;
 	void getClosestPoint(const Point& pt, Point& ptClosestPt) const;
 	float getDistanceToCurve(const Point& normalized_point) const;
 	void moveControlPoint(const int iCtrlPt, const Point& ptNewPt);
-	void moveControlPoints(const std::vector<int>& ivCtrlPts, const Point& ptOffset,
+	void moveControlPoints(const std::unordered_set<int>& isCtrlPts, const Point& ptOffset,
 		const float fMinY, const float fMaxY);
 
 	int controlPointCount(void) const;
+	const std::vector<Point>& controlPoints(void) const { return m_ptvCtrlPts; }
+	// replaces all the control points at once, for loading whole curves
+	void setControlPoints(const Point* pptCtrlPts, const int iCount,
+		const float fMaxX, const bool bWrap);
 	int segmentCount(void) const;
 
 	void wrap(bool bWrap);
 	bool wrap() const;
 	void drawEvaluatedCurveSegments(void) const;
+	// draws the part of the curve between fMinX and fMaxX on a view
+	// iColumns pixels wide, with no more than about two points per pixel
+	void drawEvaluatedCurveSegments(const float fMinX, const float fMaxX, 
+		const int iColumns) const;
 	void drawControlPoints(void) const;
 	void drawControlPoint(int iCtrlPt) const;
 	void drawCurve(void) const;
 	void invalidate(void) const;
+	// changes every time the curve is edited or invalidated, so that
+	// anything derived from the curve can tell when it is out of date
+	int revision(void) const { return m_iRevision; }
 
 	void toStream(std::ostream& output_stream) const;
 	void fromStream(std::istream& input_stream);
+	// reads what toStream writes; false if the text is malformed
+	bool fromText(TextScanner& tsScanner);
 
 protected:
 	void init(const float fStartYValue = 0.0f);
 	void reevaluate(void) const;
+	static float interpolate(const Point& point_one, const Point& point_two, const float x);
 	// this must be called when a control point is added
 	void sortControlPoints(void) const;
+	void buildDrawPoints(const float fMinX, const float fMaxX, const int iColumns) const;
+	void buildControlPointIndex(void) const;
+	// false if the block is too far away in x for it or any block beyond
+	// it to have a point closer than fMinDistSquared
+	bool closestControlPointInBlock(const int iBlock, const Point& point, 
+		int& iMinDistPt, float& fMinDistSquared) const;
 
 	const CurveEvaluator* m_pceEvaluator;
 
 	mutable std::vector<Point> m_ptvCtrlPts;
 	mutable std::vector<Point> m_ptvEvaluatedCurvePts;
+	mutable CurveEvaluationScratch m_scratch;
 	mutable bool m_bDirty;
+	mutable int m_iRevision;
+	// the line last drawn by drawEvaluatedCurveSegments and the revision
+	// and view it was built for
+	mutable std::vector<Point> m_ptvDrawPts;
+	mutable int m_iDrawRevision;
+	mutable float m_fDrawMinX;
+	mutable float m_fDrawMaxX;
+	mutable int m_iDrawColumns;
+	// the control point index: the lowest and highest y of each block of
+	// s_iCtrlPtBlockSize control points, in x order, and the revision it
+	// was built for
+	mutable std::vector<float> m_fvBlockMinY;
+	mutable std::vector<float> m_fvBlockMaxY;
+	mutable int m_iIndexRevision;
+
+	// the changes collected since beginEdit
+	bool m_bEditing;
+	std::vector<Point> m_ptvEditInserts;
+	std::vector<int> m_ivEditRemovals;
 
 	float m_fMaxX;
 	bool m_bWrap;
 	static float s_fCtrlPtXEpsilon;
+	static const int s_iCtrlPtBlockSize;
 };
 
 std::ostream& operator<<(std::ostream& output_stream, const Curve& curve_data);
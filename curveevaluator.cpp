@@ -1,8 +1,147 @@
 #include "CurveEvaluator.h"
 
+#include <algorithm>
+#include <iterator>
+
+// evaluate four samples at a time when SSE is available
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define CURVE_EVALUATOR_USE_SSE
+#include <xmmintrin.h>
+#endif
+
 float CurveEvaluator::s_fFlatnessEpsilon = 0.00001f;
 int CurveEvaluator::s_iSegCount = 16;
+int CurveEvaluator::s_iBezierSampleCount = 100;
 
 CurveEvaluator::~CurveEvaluator(void)
 {
 }
+
+Point CurveEvaluator::ctrlPtAt(const Point* pptCtrlPts, const int iCtrlPtCount,
+							   const int iCtrlPt, const float fAniLength, const bool bWrap)
+{
+	if (!bWrap) {
+		if (iCtrlPt < 0)
+			return pptCtrlPts[0];
+		if (iCtrlPt >= iCtrlPtCount)
+			return pptCtrlPts[iCtrlPtCount - 1];
+		return pptCtrlPts[iCtrlPt];
+	}
+
+	// how many times the index went around the animation
+	int iWraps = iCtrlPt / iCtrlPtCount;
+	if (iCtrlPt < 0 && iCtrlPt % iCtrlPtCount != 0)
+		--iWraps;
+
+	const Point& ptCtrlPt = pptCtrlPts[iCtrlPt - iWraps * iCtrlPtCount];
+	if (iWraps == 0)
+		return ptCtrlPt;
+	return Point(ptCtrlPt.x + iWraps * fAniLength, ptCtrlPt.y);
+}
+
+void CurveEvaluator::mergeWrappedPoints(std::vector<Point>& ptvEvaluatedCurvePts,
+										CurveEvaluationScratch& scratch)
+{
+	const std::vector<Point>& ptvWrappedPts = scratch.ptvWrappedPts;
+
+	// the unwrapped run is checked even when nothing was wrapped, since
+	// a folded segment leaves it out of order
+	if (!std::is_sorted(ptvEvaluatedCurvePts.begin(), ptvEvaluatedCurvePts.end(), PointSmallerXCompare()) ||
+		!std::is_sorted(ptvWrappedPts.begin(), ptvWrappedPts.end(), PointSmallerXCompare())) {
+		ptvEvaluatedCurvePts.insert(ptvEvaluatedCurvePts.end(), ptvWrappedPts.begin(), ptvWrappedPts.end());
+		std::sort(ptvEvaluatedCurvePts.begin(), ptvEvaluatedCurvePts.end(), PointSmallerXCompare());
+	}
+	else if (ptvWrappedPts.empty()) {
+		return;
+	}
+	else if (ptvEvaluatedCurvePts.empty() || ptvWrappedPts.back().x <= ptvEvaluatedCurvePts.front().x) {
+		// the wrapped samples normally all lie in front of the first
+		// unwrapped one, so they only need to go in at the front
+		ptvEvaluatedCurvePts.insert(ptvEvaluatedCurvePts.begin(), ptvWrappedPts.begin(), ptvWrappedPts.end());
+	}
+	else {
+		// std::inplace_merge would allocate a buffer on every call, so
+		// merge into the scratch vector and trade it for the result
+		std::vector<Point>& ptvMergedPts = scratch.ptvMergedPts;
+		ptvMergedPts.clear();
+		std::merge(ptvWrappedPts.begin(), ptvWrappedPts.end(),
+			ptvEvaluatedCurvePts.begin(), ptvEvaluatedCurvePts.end(),
+			std::back_inserter(ptvMergedPts), PointSmallerXCompare());
+		ptvEvaluatedCurvePts.swap(ptvMergedPts);
+	}
+}
+
+void CurveEvaluator::tessellateBezier(const Point& v0, const Point& v1, 
+									  const Point& v2, const Point& v3, const float fAniLength,
+									  std::vector<Point>& ptvEvaluatedCurvePts, std::vector<Point>* pptvWrappedPts)
+{
+	// the samples are written into the vector as x, y float pairs
+	static_assert(sizeof(Point) == 2 * sizeof(float), "Point must be two packed floats");
+
+	const int iSampleCount = s_iBezierSampleCount;
+	const float fStep = 1.0f / iSampleCount;
+
+	// power basis coefficients, so each sample is ((a * u + b) * u + c) * u + d
+	const float ax = v3.x - v0.x + 3.0f * (v1.x - v2.x);
+	const float bx = 3.0f * (v0.x - 2.0f * v1.x + v2.x);
+	const float cx = 3.0f * (v1.x - v0.x);
+	const float dx = v0.x;
+	const float ay = v3.y - v0.y + 3.0f * (v1.y - v2.y);
+	const float by = 3.0f * (v0.y - 2.0f * v1.y + v2.y);
+	const float cy = 3.0f * (v1.y - v0.y);
+	const float dy = v0.y;
+
+	const int iFirstSample = ptvEvaluatedCurvePts.size();
+	ptvEvaluatedCurvePts.resize(iFirstSample + iSampleCount);
+	float* pfOut = &ptvEvaluatedCurvePts[iFirstSample].x;
+
+	int i = 0;
+#ifdef CURVE_EVALUATOR_USE_SSE
+	const __m128 ax4 = _mm_set1_ps(ax);
+	const __m128 bx4 = _mm_set1_ps(bx);
+	const __m128 cx4 = _mm_set1_ps(cx);
+	const __m128 dx4 = _mm_set1_ps(dx);
+	const __m128 ay4 = _mm_set1_ps(ay);
+	const __m128 by4 = _mm_set1_ps(by);
+	const __m128 cy4 = _mm_set1_ps(cy);
+	const __m128 dy4 = _mm_set1_ps(dy);
+	const __m128 step4 = _mm_set1_ps(fStep);
+	const __m128 four4 = _mm_set1_ps(4.0f);
+	__m128 index4 = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+	for (; i + 4 <= iSampleCount; i += 4) {
+		__m128 u4 = _mm_mul_ps(index4, step4);
+		__m128 x4 = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(
+			_mm_mul_ps(ax4, u4), bx4), u4), cx4), u4), dx4);
+		__m128 y4 = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(
+			_mm_mul_ps(ay4, u4), by4), u4), cy4), u4), dy4);
+
+		// interleave into x0 y0 x1 y1 and x2 y2 x3 y3
+		_mm_storeu_ps(pfOut + 2 * i, _mm_unpacklo_ps(x4, y4));
+		_mm_storeu_ps(pfOut + 2 * i + 4, _mm_unpackhi_ps(x4, y4));
+
+		index4 = _mm_add_ps(index4, four4);
+	}
+#endif // CURVE_EVALUATOR_USE_SSE
+	for (; i < iSampleCount; ++i) {
+		float u = (float)i * fStep;
+		pfOut[2 * i] = ((ax * u + bx) * u + cx) * u + dx;
+		pfOut[2 * i + 1] = ((ay * u + by) * u + cy) * u + dy;
+	}
+
+	// take the samples outside the animation out of the run
+	std::vector<Point>::iterator itWrite = ptvEvaluatedCurvePts.begin() + iFirstSample;
+	for (std::vector<Point>::iterator it = itWrite; it != ptvEvaluatedCurvePts.end(); ++it) {
+		if (pptvWrappedPts) {
+			if (it->x >= fAniLength) {
+				pptvWrappedPts->push_back(Point(it->x - fAniLength, it->y));
+				continue;
+			}
+		}
+		else if (it->x < 0.0f || it->x > fAniLength) {
+			continue;
+		}
+		*itWrite++ = *it;
+	}
+	ptvEvaluatedCurvePts.erase(itWrite, ptvEvaluatedCurvePts.end());
+}
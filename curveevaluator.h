@@ -11,12 +11,42 @@ class CurveEvaluator
 {
 public:
 	virtual ~CurveEvaluator(void);
-	virtual void evaluateCurve(const std::vector<Point>& control_points, 
+	// The evaluated curve points must come out sorted by x (equal x
+	// values are allowed). Curve relies on this and no longer sorts them.
+	// The control points are passed as an array so that no copy is made;
+	// scratch holds working storage that is kept between evaluations.
+	virtual void evaluateCurve(const Point* control_points, 
+							   const int control_point_count,
 							   std::vector<Point>& evaluated_curve_points, 
 							   const float& animation_length, 
-							   const bool& wrap_control_points) const = 0;
+							   const bool& wrap_control_points,
+							   CurveEvaluationScratch& scratch) const = 0;
 	static float s_fFlatnessEpsilon;
 	static int s_iSegCount;
+	// number of samples taken along each cubic segment
+	static int s_iBezierSampleCount;
+
+protected:
+	// Returns control point iCtrlPt, where indices past either end stand
+	// for shadow points: when wrapping, copies of the points shifted by a
+	// multiple of animation_length; otherwise the nearest end point.
+	static Point ctrlPtAt(const Point* pptCtrlPts, const int iCtrlPtCount,
+		const int iCtrlPt, const float fAniLength, const bool bWrap);
+	// Merges the samples that were wrapped around to the front of the
+	// animation (scratch.ptvWrappedPts, already x - animation_length) into
+	// the evaluated points. Both runs are checked to be ordered; if a segment
+	// folded back on itself the points are sorted as a fallback. Interleaved
+	// runs are merged through scratch.ptvMergedPts rather than in place.
+	static void mergeWrappedPoints(std::vector<Point>& ptvEvaluatedCurvePts,
+		CurveEvaluationScratch& scratch);
+	// Samples the cubic bezier v0 v1 v2 v3 at s_iBezierSampleCount parameter
+	// values in [0, 1) and appends the samples to ptvEvaluatedCurvePts.
+	// Samples at or past animation_length are moved to pptvWrappedPts (as
+	// x - animation_length); if pptvWrappedPts is NULL, samples outside
+	// [0, animation_length] are dropped instead.
+	static void tessellateBezier(const Point& v0, const Point& v1, 
+		const Point& v2, const Point& v3, const float fAniLength,
+		std::vector<Point>& ptvEvaluatedCurvePts, std::vector<Point>* pptvWrappedPts);
 };
 
 
@@ -0,0 +1,110 @@
+#include "editjournal.h"
+
+#ifdef _DEBUG
+#include <assert.h>
+#endif // _DEBUG
+
+EditJournal::EditJournal(const int iCapacity /* = 1 << 17 */) :
+	m_edvRing(iCapacity),
+	m_iFirst(0),
+	m_iCursor(0),
+	m_iLast(0),
+	m_bInStep(false),
+	m_iStepStart(0),
+	m_bOverflow(false)
+{
+#ifdef _DEBUG
+	assert(iCapacity > 0);
+#endif // _DEBUG
+}
+
+void EditJournal::clear()
+{
+	m_iFirst = m_iCursor = m_iLast = 0;
+	m_bInStep = false;
+	m_bOverflow = false;
+}
+
+void EditJournal::beginStep()
+{
+	m_bInStep = false;
+	m_bOverflow = false;
+}
+
+void EditJournal::record(const EditDelta& edDelta)
+{
+	if (m_bOverflow)
+		return;
+
+	// the steps after the cursor can no longer be redone
+	m_iLast = m_iCursor;
+
+	bool bStepStart = !m_bInStep;
+	if (bStepStart) {
+		m_bInStep = true;
+		m_iStepStart = m_iLast;
+	}
+
+	int iCapacity = m_edvRing.size();
+	if (m_iLast - m_iFirst == iCapacity) {
+		if (m_iStepStart == m_iFirst) {
+			// the step fills the whole ring
+			m_iFirst = m_iCursor = m_iLast;
+			m_bOverflow = true;
+			return;
+		}
+
+		// forget the oldest step
+		do {
+			++m_iFirst;
+		} while (m_iFirst < m_iStepStart && !at(m_iFirst).bStepStart);
+	}
+
+	EditDelta& edRecorded = at(m_iLast);
+	edRecorded = edDelta;
+	edRecorded.bStepStart = bStepStart;
+	m_iCursor = ++m_iLast;
+
+	// keep the counts from growing without changing where they fall in
+	// the ring
+	if (m_iFirst >= iCapacity) {
+		m_iFirst -= iCapacity;
+		m_iCursor -= iCapacity;
+		m_iLast -= iCapacity;
+		m_iStepStart -= iCapacity;
+	}
+}
+
+bool EditJournal::undo(EditApply_f pfApply, void* pvTarget)
+{
+	m_bInStep = false;
+
+	if (!canUndo())
+		return false;
+
+	m_edvStep.clear();
+	do {
+		--m_iCursor;
+		m_edvStep.push_back(at(m_iCursor));
+	} while (m_iCursor > m_iFirst && !m_edvStep.back().bStepStart);
+
+	pfApply(&m_edvStep[0], m_edvStep.size(), true, pvTarget);
+	return true;
+}
+
+bool EditJournal::redo(EditApply_f pfApply, void* pvTarget)
+{
+	m_bInStep = false;
+
+	if (!canRedo())
+		return false;
+
+	m_edvStep.clear();
+	do {
+		m_edvStep.push_back(at(m_iCursor));
+		++m_iCursor;
+	} while (m_iCursor < m_iLast && !at(m_iCursor).bStepStart);
+
+	pfApply(&m_edvStep[0], m_edvStep.size(), false, pvTarget);
+	return true;
+}
@@ -0,0 +1,90 @@
+#ifndef EDITJOURNAL_H_INCLUDED
+#define EDITJOURNAL_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+
+// One recorded change. The deltas are small and all of one size, so that
+// the journal keeps them in a ring without allocating; what the values
+// hold depends on the kind.
+struct EditDelta
+{
+	enum Kind
+	{
+		// control point iIndex of curve iTarget went from fvValues[0..1]
+		// to fvValues[2..3]
+		kMovePoint,
+		// control point iIndex of curve iTarget, at fvValues[0..1], was
+		// added or removed. The indices of a run of removals from one
+		// curve are those before the run.
+		kInsertPoint,
+		kRemovePoint,
+		// the type or the wrapping of curve iTarget went from ivValues[0]
+		// to ivValues[1]
+		kCurveType,
+		kWrap,
+		// a camera keyframe was added or removed. fvValues hold its time,
+		// azimuth, elevation, dolly and look at point.
+		kInsertCameraKey,
+		kRemoveCameraKey
+	};
+
+	unsigned char byKind;
+	// the first delta of a step
+	bool bStepStart;
+	int iTarget;
+	int iIndex;
+	union {
+		float fvValues[7];
+		int ivValues[7];
+	};
+};
+
+// Applies the deltas of a step in the order given: newest first when
+// undoing, oldest first when redoing
+typedef void (*EditApply_f)(const EditDelta* pedDeltas, const int iCount,
+	const bool bUndo, void* pvTarget);
+
+// The undo history. The deltas of the recent edits are kept in a ring of
+// a fixed number of them, and grouped into steps that are undone and
+// redone as a whole. When the ring is full the oldest steps are forgotten;
+// a single step that does not fit is not kept, and neither is anything
+// before it. Recording after an undo forgets the steps that could have
+// been redone.
+class EditJournal
+{
+public:
+	explicit EditJournal(const int iCapacity = 1 << 17);
+
+	void clear();
+	// the deltas recorded from now on, up to the next beginStep, undo or
+	// redo, are one step. A step with no deltas is not kept.
+	void beginStep();
+	void record(const EditDelta& edDelta);
+
+	bool canUndo() const { return m_iCursor > m_iFirst; }
+	bool canRedo() const { return m_iCursor < m_iLast; }
+	// hand the deltas of the step to pfApply; false if there is none
+	bool undo(EditApply_f pfApply, void* pvTarget);
+	bool redo(EditApply_f pfApply, void* pvTarget);
+
+protected:
+	std::vector<EditDelta> m_edvRing;
+	// the deltas kept are m_iFirst up to m_iLast, counting from one that
+	// is at the start of the ring, and the next undo starts at m_iCursor
+	int m_iFirst;
+	int m_iCursor;
+	int m_iLast;
+	// where the step being recorded starts, if there is one
+	bool m_bInStep;
+	int m_iStepStart;
+	// the step being recorded did not fit
+	bool m_bOverflow;
+	// the step being undone or redone, in order
+	std::vector<EditDelta> m_edvStep;
+
+	EditDelta& at(const int iDelta) { return m_edvRing[iDelta % m_edvRing.size()]; }
+};
+
+#endif // EDITJOURNAL_H_INCLUDED
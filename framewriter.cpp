@@ -0,0 +1,261 @@
+#include "framewriter.h"
+#include "bitmap.h"
+
+#include <string.h>
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif // WIN32
+
+FrameWriter* FrameWriter::create(const char* szFormat)
+{
+	if (!strcmp(szFormat, "bmp"))
+		return new BMPFrameWriter();
+	if (!strcmp(szFormat, "qoi"))
+		return new QOIFrameWriter();
+	if (!strcmp(szFormat, "y4m"))
+		return new Y4MFrameWriter();
+	if (!strcmp(szFormat, "rgb"))
+		return new RawFrameWriter();
+	return NULL;
+}
+
+bool FrameWriter::begin(const char* szBaseName, int iFps)
+{
+	m_strBaseName = szBaseName;
+	m_iFps = iFps;
+	return true;
+}
+
+std::string FrameWriter::frameFileName(int iFrameNum, const char* szExt) const
+{
+	char szFrameNum[128];
+	_snprintf(szFrameNum, 128, "%d", iFrameNum);
+	szFrameNum[127] = 0;
+	return m_strBaseName + szFrameNum + szExt;
+}
+
+bool FrameWriter::writeFile(const char* szFileName, int iBytes) const
+{
+	FILE* pfFile = fopen(szFileName, "wb");
+	if (!pfFile)
+		return false;
+
+	// the buffer holds the whole file, so skip the stdio copy
+	setvbuf(pfFile, NULL, _IONBF, 0);
+	bool bWritten = fwrite(&m_ucvBuffer[0], iBytes, 1, pfFile) == 1;
+	fclose(pfFile);
+	return bWritten;
+}
+
+// streams go to stdout, which must not translate line ends on windows
+static void openStdoutStream()
+{
+#ifdef WIN32
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif // WIN32
+	setvbuf(stdout, NULL, _IONBF, 0);
+}
+
+bool BMPFrameWriter::writeFrame(int iFrameNum, int iWidth, int iHeight, const unsigned char* pbyData)
+{
+	int iBytes = bmpFileSize(iWidth, iHeight);
+	if ((int)m_ucvBuffer.size() < iBytes)
+		m_ucvBuffer.resize(iBytes);
+	encodeBMP(iWidth, iHeight, pbyData, &m_ucvBuffer[0]);
+	return writeFile(frameFileName(iFrameNum, ".bmp").c_str(), iBytes);
+}
+
+static inline unsigned char* putBigEndian32(unsigned char* pbyOut, unsigned int uiValue)
+{
+	pbyOut[0] = (unsigned char)(uiValue >> 24);
+	pbyOut[1] = (unsigned char)(uiValue >> 16);
+	pbyOut[2] = (unsigned char)(uiValue >> 8);
+	pbyOut[3] = (unsigned char)uiValue;
+	return pbyOut + 4;
+}
+
+bool QOIFrameWriter::writeFrame(int iFrameNum, int iWidth, int iHeight, const unsigned char* pbyData)
+{
+	// header, at most one tag byte and three color bytes per pixel,
+	// and the end marker
+	int iMaxBytes = 14 + 4 * iWidth * iHeight + 8;
+	if ((int)m_ucvBuffer.size() < iMaxBytes)
+		m_ucvBuffer.resize(iMaxBytes);
+
+	unsigned char* pbyOut = &m_ucvBuffer[0];
+	memcpy(pbyOut, "qoif", 4);
+	pbyOut = putBigEndian32(pbyOut + 4, iWidth);
+	pbyOut = putBigEndian32(pbyOut, iHeight);
+	*pbyOut++ = 3;	// rgb
+	*pbyOut++ = 0;	// srgb
+
+	// recently seen colors, indexed by a hash of the color. The frames
+	// have no alpha, which always hashes as 255.
+	unsigned char byvIndex[64][3];
+	memset(byvIndex, 0, sizeof(byvIndex));
+	bool bvIndexed[64];
+	memset(bvIndexed, 0, sizeof(bvIndexed));
+
+	unsigned char byPrevR = 0, byPrevG = 0, byPrevB = 0;
+	int iRun = 0;
+	int iPixels = iWidth * iHeight;
+
+	// qoi images are top down
+	for (int j = iHeight - 1; j >= 0; --j) {
+		const unsigned char* pbyIn = pbyData + j * 3 * iWidth;
+		for (int i = 0; i < iWidth; ++i, pbyIn += 3) {
+			unsigned char r = pbyIn[0], g = pbyIn[1], b = pbyIn[2];
+			--iPixels;
+
+			if (r == byPrevR && g == byPrevG && b == byPrevB) {
+				++iRun;
+				if (iRun == 62 || iPixels == 0) {
+					*pbyOut++ = (unsigned char)(0xc0 | (iRun - 1));
+					iRun = 0;
+				}
+				continue;
+			}
+
+			if (iRun > 0) {
+				*pbyOut++ = (unsigned char)(0xc0 | (iRun - 1));
+				iRun = 0;
+			}
+
+			int iHash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+			// a zeroed slot only matches black when it has been filled, as
+			// the decoder's index starts with transparent black
+			if (bvIndexed[iHash] && byvIndex[iHash][0] == r &&
+				byvIndex[iHash][1] == g && byvIndex[iHash][2] == b) {
+				*pbyOut++ = (unsigned char)iHash;
+			}
+			else {
+				byvIndex[iHash][0] = r;
+				byvIndex[iHash][1] = g;
+				byvIndex[iHash][2] = b;
+				bvIndexed[iHash] = true;
+
+				signed char dr = (signed char)(r - byPrevR);
+				signed char dg = (signed char)(g - byPrevG);
+				signed char db = (signed char)(b - byPrevB);
+				signed char drdg = (signed char)(dr - dg);
+				signed char dbdg = (signed char)(db - dg);
+
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+					*pbyOut++ = (unsigned char)(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+				}
+				else if (dg >= -32 && dg <= 31 && drdg >= -8 && drdg <= 7 && dbdg >= -8 && dbdg <= 7) {
+					*pbyOut++ = (unsigned char)(0x80 | (dg + 32));
+					*pbyOut++ = (unsigned char)(((drdg + 8) << 4) | (dbdg + 8));
+				}
+				else {
+					*pbyOut++ = 0xfe;
+					*pbyOut++ = r;
+					*pbyOut++ = g;
+					*pbyOut++ = b;
+				}
+			}
+
+			byPrevR = r;
+			byPrevG = g;
+			byPrevB = b;
+		}
+	}
+
+	static const unsigned char s_byvEndMarker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	memcpy(pbyOut, s_byvEndMarker, 8);
+	pbyOut += 8;
+
+	return writeFile(frameFileName(iFrameNum, ".qoi").c_str(), (int)(pbyOut - &m_ucvBuffer[0]));
+}
+
+Y4MFrameWriter::Y4MFrameWriter() :
+	m_iStreamWidth(0),
+	m_iStreamHeight(0)
+{
+}
+
+bool Y4MFrameWriter::begin(const char* szBaseName, int iFps)
+{
+	FrameWriter::begin(szBaseName, iFps);
+	openStdoutStream();
+	// the header goes out with the first frame, once the size is known
+	m_iStreamWidth = 0;
+	m_iStreamHeight = 0;
+	return true;
+}
+
+bool Y4MFrameWriter::writeFrame(int /*iFrameNum*/, int iWidth, int iHeight, const unsigned char* pbyData)
+{
+	// a stream cannot change its size
+	if (m_iStreamWidth && (iWidth != m_iStreamWidth || iHeight != m_iStreamHeight))
+		return false;
+
+	int iChromaWidth = (iWidth + 1) / 2;
+	int iChromaHeight = (iHeight + 1) / 2;
+	int iMaxBytes = 128 + iWidth * iHeight + 2 * iChromaWidth * iChromaHeight;
+	if ((int)m_ucvBuffer.size() < iMaxBytes)
+		m_ucvBuffer.resize(iMaxBytes);
+
+	char* szOut = (char*)&m_ucvBuffer[0];
+	int iHeader = 0;
+	if (!m_iStreamWidth) {
+		iHeader = _snprintf(szOut, 128, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+			iWidth, iHeight, m_iFps);
+		m_iStreamWidth = iWidth;
+		m_iStreamHeight = iHeight;
+	}
+	memcpy(szOut + iHeader, "FRAME\n", 6);
+
+	unsigned char* pbyY = &m_ucvBuffer[iHeader + 6];
+	unsigned char* pbyU = pbyY + iWidth * iHeight;
+	unsigned char* pbyV = pbyU + iChromaWidth * iChromaHeight;
+
+	// bt.601 studio range, top down
+	for (int j = 0; j < iHeight; ++j) {
+		const unsigned char* pbyIn = pbyData + (iHeight - 1 - j) * 3 * iWidth;
+		for (int i = 0; i < iWidth; ++i, pbyIn += 3)
+			*pbyY++ = (unsigned char)(((66 * pbyIn[0] + 129 * pbyIn[1] + 25 * pbyIn[2] + 128) >> 8) + 16);
+	}
+
+	// chroma from the average of each 2x2 block
+	for (int j = 0; j < iChromaHeight; ++j) {
+		int iRow0 = iHeight - 1 - 2 * j;
+		int iRow1 = iRow0 > 0 ? iRow0 - 1 : iRow0;
+		const unsigned char* pbyIn0 = pbyData + iRow0 * 3 * iWidth;
+		const unsigned char* pbyIn1 = pbyData + iRow1 * 3 * iWidth;
+		for (int i = 0; i < iChromaWidth; ++i) {
+			int i0 = 2 * i * 3;
+			int i1 = (2 * i + 1 < iWidth) ? i0 + 3 : i0;
+			int r = pbyIn0[i0] + pbyIn0[i1] + pbyIn1[i0] + pbyIn1[i1];
+			int g = pbyIn0[i0 + 1] + pbyIn0[i1 + 1] + pbyIn1[i0 + 1] + pbyIn1[i1 + 1];
+			int b = pbyIn0[i0 + 2] + pbyIn0[i1 + 2] + pbyIn1[i0 + 2] + pbyIn1[i1 + 2];
+			*pbyU++ = (unsigned char)(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+			*pbyV++ = (unsigned char)(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+		}
+	}
+
+	int iBytes = (int)(pbyV - &m_ucvBuffer[0]);
+	return fwrite(&m_ucvBuffer[0], iBytes, 1, stdout) == 1;
+}
+
+bool RawFrameWriter::begin(const char* szBaseName, int iFps)
+{
+	FrameWriter::begin(szBaseName, iFps);
+	openStdoutStream();
+	return true;
+}
+
+bool RawFrameWriter::writeFrame(int /*iFrameNum*/, int iWidth, int iHeight, const unsigned char* pbyData)
+{
+	int iRowBytes = 3 * iWidth;
+	int iBytes = iRowBytes * iHeight;
+	if ((int)m_ucvBuffer.size() < iBytes)
+		m_ucvBuffer.resize(iBytes);
+
+	// flip to top down
+	for (int j = 0; j < iHeight; ++j)
+		memcpy(&m_ucvBuffer[j * iRowBytes], pbyData + (iHeight - 1 - j) * iRowBytes, iRowBytes);
+
+	return fwrite(&m_ucvBuffer[0], iBytes, 1, stdout) == 1;
+}
@@ -0,0 +1,80 @@
+#ifndef FRAMEWRITER_H_INCLUDED
+#define FRAMEWRITER_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Writes the frames of a movie. Frames are rows of (R,G,B) bytes from the
+// bottom of the image up, as read back from OpenGL. Every writer encodes a
+// frame into a buffer it keeps between frames and hands it to the system
+// in a single write.
+class FrameWriter
+{
+public:
+	virtual ~FrameWriter() {}
+
+	// returns the writer for "bmp", "qoi", "y4m" or "rgb", NULL for an
+	// unknown format
+	static FrameWriter* create(const char* szFormat);
+
+	// file writers save frame i to szBaseName followed by i and their
+	// extension; stream writers ignore the name and write to stdout
+	virtual bool begin(const char* szBaseName, int iFps);
+	virtual bool writeFrame(int iFrameNum, int iWidth, int iHeight, const unsigned char* pbyData) = 0;
+	virtual void end() {}
+
+	// stream writers need the frames in order and from one process
+	virtual bool streaming() const { return false; }
+
+protected:
+	std::string m_strBaseName;
+	int m_iFps;
+	std::vector<unsigned char> m_ucvBuffer;
+
+	std::string frameFileName(int iFrameNum, const char* szExt) const;
+	bool writeFile(const char* szFileName, int iBytes) const;
+};
+
+// uncompressed 24 bit .bmp files, readable by readBMP
+class BMPFrameWriter : public FrameWriter
+{
+public:
+	virtual bool writeFrame(int iFrameNum, int iWidth, int iHeight, const unsigned char* pbyData);
+};
+
+// losslessly compressed .qoi files; a few times smaller than .bmp for
+// rendered frames and about as fast to write
+class QOIFrameWriter : public FrameWriter
+{
+public:
+	virtual bool writeFrame(int iFrameNum, int iWidth, int iHeight, const unsigned char* pbyData);
+};
+
+// a YUV4MPEG2 stream with 4:2:0 chroma on stdout, for piping into an
+// external encoder
+class Y4MFrameWriter : public FrameWriter
+{
+public:
+	Y4MFrameWriter();
+	virtual bool begin(const char* szBaseName, int iFps);
+	virtual bool writeFrame(int iFrameNum, int iWidth, int iHeight, const unsigned char* pbyData);
+	virtual bool streaming() const { return true; }
+
+protected:
+	int m_iStreamWidth;
+	int m_iStreamHeight;
+};
+
+// headerless top-down rgb24 frames on stdout
+class RawFrameWriter : public FrameWriter
+{
+public:
+	virtual bool begin(const char* szBaseName, int iFps);
+	virtual bool writeFrame(int iFrameNum, int iWidth, int iHeight, const unsigned char* pbyData);
+	virtual bool streaming() const { return true; }
+};
+
+#endif // FRAMEWRITER_H_INCLUDED
@@ -23,6 +23,7 @@
 #include <fstream>
 
 #include "GraphWidget.h"
+#include "textscanner.h"
 
 #include "LinearCurveEvaluator.h"
 #include "BezierCurveEvaluator.h"
@@ -99,11 +100,24 @@ static const Fl_Color flcvColors[CURVE_COLOR_COUNT] = {
 
 const static float ks_fViewportMargin = 0.01f;
 
+// a journal entry for an edit of one control point
+static EditDelta pointDelta(const int iKind, const int iCurve, const int iCtrlPt, 
+							const Point& ptCtrlPt)
+{
+	EditDelta edDelta;
+	edDelta.byKind = iKind;
+	edDelta.iTarget = iCurve;
+	edDelta.iIndex = iCtrlPt;
+	edDelta.fvValues[0] = ptCtrlPt.x;
+	edDelta.fvValues[1] = ptCtrlPt.y;
+	return edDelta;
+}
+
 GraphWidget::GraphWidget(int x, int y, int w, int h, const char *label) :
 Fl_Gl_Window(x, y, w, h, label),
 m_bHasCtrlPtSelection(false),
 m_bHasZoomSelection(false),
-m_ivvCurrCtrlPts(),
+m_isvCurrCtrlPts(),
 m_ppceCurveEvaluators(NULL),
 m_pcrvvCurves(),
 m_ivCurveTypes(),
@@ -111,12 +125,22 @@ m_iCurrCurve(-1),
 m_ivActiveCurves(),
 m_fEndTime(20.0f),
 m_fCurrTime(0.0f),
+m_bDamagedCurve(false),
 m_rectCurrViewport(0.0f - ks_fViewportMargin, 1.0f + ks_fViewportMargin, 0.0f - ks_fViewportMargin, 1.0f + ks_fViewportMargin),
 m_bPanning(false),
 m_bHasEvent(false),
 m_bLButtonDown(false),
 m_bRButtonDown(false),
-m_flcCurrCurve(FL_BLACK)
+m_flcCurrCurve(FL_BLACK),
+m_uiGridList(0),
+m_fGridLeftTime(0.0f),
+m_fGridRightTime(0.0f),
+m_iGridWidth(0),
+m_iGridHeight(0),
+m_uiLayerTexture(0),
+m_iLayerTextureWidth(0),
+m_iLayerTextureHeight(0),
+m_fLayerEndTime(0.0f)
 {
 	m_ppceCurveEvaluators = new CurveEvaluator*[CURVE_TYPE_COUNT];
 
@@ -133,6 +157,8 @@ m_flcCurrCurve(FL_BLACK)
 
 GraphWidget::~GraphWidget()
 {
+	m_apScript.close();
+
 	for (int iCurve = 0; iCurve < m_pcrvvCurves.size(); ++iCurve) {
 		delete m_pcrvvCurves[iCurve];
 	}
@@ -150,8 +176,9 @@ int GraphWidget::addCurve(const float fStartVal, const float fMinY, const float
 
 	m_pcrvvCurves.push_back(pcrv);
 	m_cdvCurveDomains.push_back(CurveDomain(fMinY, fMaxY));
+	m_fvStartValues.push_back(fStartVal);
 	m_ivCurveTypes.push_back(CURVE_TYPE_LINEAR);
-	m_ivvCurrCtrlPts.push_back(std::vector<int>());
+	m_isvCurrCtrlPts.push_back(int_set());
 
 	return m_pcrvvCurves.size() - 1;
 }
@@ -175,6 +202,16 @@ void GraphWidget::currCurveType(int iCurveType)
 {
 	if (m_iCurrCurve >= 0 && 
 		iCurveType >= 0 && iCurveType < CURVE_TYPE_COUNT) {
+		if (iCurveType != m_ivCurveTypes[m_iCurrCurve]) {
+			EditDelta edDelta;
+			edDelta.byKind = EditDelta::kCurveType;
+			edDelta.iTarget = m_iCurrCurve;
+			edDelta.iIndex = 0;
+			edDelta.ivValues[0] = m_ivCurveTypes[m_iCurrCurve];
+			edDelta.ivValues[1] = iCurveType;
+			m_ejJournal.beginStep();
+			m_ejJournal.record(edDelta);
+		}
 		m_pcrvvCurves[m_iCurrCurve]->setEvaluator(m_ppceCurveEvaluators[iCurveType]);
 		m_ivCurveTypes[m_iCurrCurve] = iCurveType;
 		m_pcrvvCurves[m_iCurrCurve]->invalidate();
@@ -193,6 +230,18 @@ int GraphWidget::currCurveType() const
 void GraphWidget::draw()
 {
 	if (!valid()) {
+		// the window was resized or its context recreated; deleting names
+		// of a context that is gone does nothing
+		if (m_uiGridList)
+			glDeleteLists(m_uiGridList, 1);
+		if (m_uiLayerTexture)
+			glDeleteTextures(1, &m_uiLayerTexture);
+		m_uiGridList = 0;
+		m_uiLayerTexture = 0;
+		m_iLayerTextureWidth = 0;
+		m_iLayerTextureHeight = 0;
+		m_ivLayerKey.clear();
+
 		glMatrixMode(GL_PROJECTION);
 		glLoadIdentity();
 		glMatrixMode(GL_MODELVIEW);
@@ -204,72 +253,6 @@ void GraphWidget::draw()
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	}
 
-	glClear(GL_COLOR_BUFFER_BIT);
-
-	glColor3d(0,0,0);
-	glBegin(GL_POLYGON);
-		glVertex2d( -w(), -h()  );
-		glVertex2d( -w(),  h()  );
-		glVertex2d(  w(),  h()  );
-		glVertex2d(  w(), -h()  );
-	glEnd();
-
-/************************************************************************************/
-
-	//The grid.. We're copying this from rulerwindow class.
-	//Really to two should have a single reference function.
-	double dRangeX = rightTime() - leftTime();
-	double dRangeY = (rightTime() - leftTime());
-	int iWindowWidth = w();
-	int iWindowHeight = h();
-	const int k_iAvgLongMarkLen = 15;
-
-	int iLongMarkCountX = iWindowWidth / k_iAvgLongMarkLen;
-	int iLongMarkCountY = iWindowHeight / k_iAvgLongMarkLen;
-
-	if (iLongMarkCountX > 0 && iWindowWidth > 0) {
-		// Computer the long mark length so that it's 10^i where i is an integer
-		double dLongMarkLengthX = dRangeX / (double)iLongMarkCountX;
-		double dLongMarkLengthPowX = log10(dLongMarkLengthX);
-		int iLongMarkLengthPowX = (int)ceil(dLongMarkLengthPowX);
-		dLongMarkLengthX = pow(10.0, (double)iLongMarkLengthPowX);
-
-		double dLongMarkLengthY = dRangeY / (double)iLongMarkCountY;
-		double dLongMarkLengthPowY = log10(dLongMarkLengthY);
-		int iLongMarkLengthPowY = (int)ceil(dLongMarkLengthPowY);
-		dLongMarkLengthY = pow(10.0, (double)iLongMarkLengthPowY);
-
-
-		int iStartX = (int)ceil(leftTime() / dLongMarkLengthX);
-
-		int iMarkX, iMarkY;
-		double x,y;
-
-		glColor3d(1,1,1);
-		glPointSize(0.5);
-		glBegin(GL_POINTS);
-
-			do {
-				iMarkX = 2*(int)(((double)iStartX * dLongMarkLengthX - leftTime()) / dRangeX * (double)iWindowWidth + 0.5) - w();
-				x = (double)iMarkX / w();
-				
-				int iStartY = (int)ceil(leftTime() / dLongMarkLengthY);
-				do{
-					iMarkY = 2*(int)(((double)iStartY * dLongMarkLengthY - leftTime()) / dRangeY * (double)iWindowHeight + 0.5) - h();
-					y = (double)iMarkY / h();
-
-					glVertex2d(x,y);
-
-					++iStartY;
-				} while (iMarkY < iWindowHeight);
-				
-				++iStartX;
-			} while (iMarkX < iWindowWidth);
-		glEnd();
-	}
-
-/************************************************************************************/
-	
 	if (m_bHasEvent) {
 		m_bHasEvent = false;
 
@@ -281,6 +264,7 @@ void GraphWidget::draw()
 				dragCtrlPt(m_iMouseX, m_iMouseY);
 				break;
 			case LEFT_MOUSE_UP:
+				endDragCtrlPt();
 				break;
 
 			case ALT_LEFT_DOWN:
@@ -335,16 +319,213 @@ void GraphWidget::draw()
 
 		do_callback();
 	}
+
+	// the background, the grid and the curves that are not being edited
+	// only change with the view or with those curves, so they are kept in
+	// a texture and the edited curves are drawn over it
+	std::vector<int> ivLayerKey;
+	layerKey(ivLayerKey);
+	if (!drawCachedLayer(ivLayerKey)) {
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		glColor3d(0,0,0);
+		glBegin(GL_POLYGON);
+			glVertex2d( -w(), -h()  );
+			glVertex2d( -w(),  h()  );
+			glVertex2d(  w(),  h()  );
+			glVertex2d(  w(), -h()  );
+		glEnd();
+
+		drawGrid();
+		drawActiveCurves(false);
+		cacheLayer(ivLayerKey);
+	}
+
 	drawTimeBar();
-	drawActiveCurves();
+	drawActiveCurves(true);
 	drawZoomSelectionMap();
 	drawSelectionRect();
 }
 
+void GraphWidget::drawGrid() const
+{
+	// the grid only changes with the view, so it is compiled once for each
+	if (m_uiGridList && m_fGridLeftTime == leftTime() && m_fGridRightTime == rightTime() &&
+		m_iGridWidth == w() && m_iGridHeight == h()) {
+		glCallList(m_uiGridList);
+		return;
+	}
+
+	if (!m_uiGridList)
+		m_uiGridList = glGenLists(1);
+	m_fGridLeftTime = leftTime();
+	m_fGridRightTime = rightTime();
+	m_iGridWidth = w();
+	m_iGridHeight = h();
+
+	glNewList(m_uiGridList, GL_COMPILE_AND_EXECUTE);
+
+	//The grid.. We're copying this from rulerwindow class.
+	//Really to two should have a single reference function.
+	double dRangeX = rightTime() - leftTime();
+	double dRangeY = (rightTime() - leftTime());
+	int iWindowWidth = w();
+	int iWindowHeight = h();
+	const int k_iAvgLongMarkLen = 15;
+
+	int iLongMarkCountX = iWindowWidth / k_iAvgLongMarkLen;
+	int iLongMarkCountY = iWindowHeight / k_iAvgLongMarkLen;
+
+	if (iLongMarkCountX > 0 && iWindowWidth > 0) {
+		// Computer the long mark length so that it's 10^i where i is an integer
+		double dLongMarkLengthX = dRangeX / (double)iLongMarkCountX;
+		double dLongMarkLengthPowX = log10(dLongMarkLengthX);
+		int iLongMarkLengthPowX = (int)ceil(dLongMarkLengthPowX);
+		dLongMarkLengthX = pow(10.0, (double)iLongMarkLengthPowX);
+
+		double dLongMarkLengthY = dRangeY / (double)iLongMarkCountY;
+		double dLongMarkLengthPowY = log10(dLongMarkLengthY);
+		int iLongMarkLengthPowY = (int)ceil(dLongMarkLengthPowY);
+		dLongMarkLengthY = pow(10.0, (double)iLongMarkLengthPowY);
+
+
+		int iStartX = (int)ceil(leftTime() / dLongMarkLengthX);
+
+		int iMarkX, iMarkY;
+		double x,y;
+
+		glColor3d(1,1,1);
+		glPointSize(0.5);
+		glBegin(GL_POINTS);
+
+			do {
+				iMarkX = 2*(int)(((double)iStartX * dLongMarkLengthX - leftTime()) / dRangeX * (double)iWindowWidth + 0.5) - w();
+				x = (double)iMarkX / w();
+				
+				int iStartY = (int)ceil(leftTime() / dLongMarkLengthY);
+				do{
+					iMarkY = 2*(int)(((double)iStartY * dLongMarkLengthY - leftTime()) / dRangeY * (double)iWindowHeight + 0.5) - h();
+					y = (double)iMarkY / h();
+
+					glVertex2d(x,y);
+
+					++iStartY;
+				} while (iMarkY < iWindowHeight);
+				
+				++iStartX;
+			} while (iMarkX < iWindowWidth);
+		glEnd();
+	}
+
+	glEndList();
+}
+
+void GraphWidget::layerKey(std::vector<int>& ivKey) const
+{
+	ivKey.clear();
+	ivKey.push_back(w());
+	ivKey.push_back(h());
+	ivKey.push_back(m_iCurrCurve);
+	// the curves in the layer, by their place in the active list, which
+	// picks their color
+	for (int i = 0; i < m_ivActiveCurves.size(); ++i) {
+		int iCurve = m_ivActiveCurves[i];
+		if (m_isvCurrCtrlPts[iCurve].empty()) {
+			ivKey.push_back(i);
+			ivKey.push_back(iCurve);
+			ivKey.push_back(m_pcrvvCurves[iCurve]->revision());
+		}
+	}
+}
+
+bool GraphWidget::drawCachedLayer(const std::vector<int>& ivKey) const
+{
+	if (!m_uiLayerTexture || ivKey != m_ivLayerKey || m_fLayerEndTime != m_fEndTime ||
+		m_rectLayerViewport.left() != m_rectCurrViewport.left() ||
+		m_rectLayerViewport.right() != m_rectCurrViewport.right() ||
+		m_rectLayerViewport.bottom() != m_rectCurrViewport.bottom() ||
+		m_rectLayerViewport.top() != m_rectCurrViewport.top())
+		return false;
+
+	float fRight = (float)w() / m_iLayerTextureWidth;
+	float fTop = (float)h() / m_iLayerTextureHeight;
+
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, m_uiLayerTexture);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glBegin(GL_QUADS);
+		glTexCoord2f(0.0f, 0.0f);	glVertex2f(-1.0f, -1.0f);
+		glTexCoord2f(fRight, 0.0f);	glVertex2f( 1.0f, -1.0f);
+		glTexCoord2f(fRight, fTop);	glVertex2f( 1.0f,  1.0f);
+		glTexCoord2f(0.0f, fTop);	glVertex2f(-1.0f,  1.0f);
+	glEnd();
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDisable(GL_TEXTURE_2D);
+
+	return true;
+}
+
+void GraphWidget::cacheLayer(const std::vector<int>& ivKey) const
+{
+	// gl 1.1 textures have power of two sizes
+	int iTextureWidth = 1;
+	while (iTextureWidth < w())
+		iTextureWidth <<= 1;
+	int iTextureHeight = 1;
+	while (iTextureHeight < h())
+		iTextureHeight <<= 1;
+
+	GLint iMaxTextureSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &iMaxTextureSize);
+	if (iTextureWidth > iMaxTextureSize || iTextureHeight > iMaxTextureSize)
+		return;
+
+	if (!m_uiLayerTexture)
+		glGenTextures(1, &m_uiLayerTexture);
+	glBindTexture(GL_TEXTURE_2D, m_uiLayerTexture);
+	if (iTextureWidth != m_iLayerTextureWidth || iTextureHeight != m_iLayerTextureHeight) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, iTextureWidth, iTextureHeight, 0, 
+			GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		m_iLayerTextureWidth = iTextureWidth;
+		m_iLayerTextureHeight = iTextureHeight;
+	}
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, w(), h());
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_ivLayerKey = ivKey;
+	m_rectLayerViewport = m_rectCurrViewport;
+	m_fLayerEndTime = m_fEndTime;
+}
+
 int GraphWidget::handle(int event)
 {
 	switch (event) {
+	case FL_FOCUS:
+	case FL_UNFOCUS:
+		// takes the keyboard, for undo and redo
+		return 1;
+
+	case FL_KEYBOARD:
+		if (Fl::event_state(FL_CTRL) && 
+			(Fl::event_key() == 'z' || Fl::event_key() == 'y')) {
+			bool bDone;
+			if (Fl::event_key() == 'y' || Fl::event_state(FL_SHIFT))
+				bDone = redo();
+			else
+				bDone = undo();
+
+			if (bDone) {
+				redraw();
+				do_callback();
+			}
+			return 1;
+		}
+		return Fl_Gl_Window::handle(event);
+
 	case FL_PUSH:
+		take_focus();
 		m_iMouseX = Fl::event_x();
 		m_iMouseY = Fl::event_y();
 		switch (Fl::event_button()) {
@@ -509,6 +690,9 @@ float GraphWidget::endTime() const
 void GraphWidget::endTime(const float fEndTime)
 {
 	if (fEndTime > 0.0) {
+		// the recorded positions are those before the control points
+		// were cut off at the new end
+		m_ejJournal.clear();
 		m_fEndTime = fEndTime;
 		for (int i = 0; i < m_pcrvvCurves.size(); ++i) {
 			m_pcrvvCurves[i]->maxX(m_fEndTime);
@@ -519,7 +703,9 @@ void GraphWidget::endTime(const float fEndTime)
 
 void GraphWidget::scaleTime(const float fScale)
 {
+	m_ejJournal.clear();
 	for (int i = 0; i < m_pcrvvCurves.size(); ++i) {
+		loadPendingCurve(i);
 		m_pcrvvCurves[i]->scaleX(fScale);
 	}
 	invalidateAllCurves();
@@ -547,6 +733,10 @@ void GraphWidget::selectCurrCurve(const int iMouseX, const int iMouseY)
 
 void GraphWidget::selectAddCtrlPt(const int iMouseX, const int iMouseY)
 {
+	// the point added here and the drag that follows are undone together
+	m_ejJournal.beginStep();
+	m_edvDrag.clear();
+
 	if (m_iCurrCurve >= 0) {
 		Point ptMouse(iMouseX, iMouseY);
 		Point ptCtrlPt;
@@ -561,16 +751,14 @@ void GraphWidget::selectAddCtrlPt(const int iMouseX, const int iMouseY)
 		if (fabs(ptCtrlPtInWindowCoord.x - ptMouse.x) * 2 <= PICK_WINDOW_SIZE &&
 			fabs(ptCtrlPtInWindowCoord.y - ptMouse.y) * 2 <= PICK_WINDOW_SIZE) {
 
-			if (std::find(m_ivvCurrCtrlPts[m_iCurrCurve].begin(), 
-				m_ivvCurrCtrlPts[m_iCurrCurve].end(), 
-				iClosestCtrlPt) != m_ivvCurrCtrlPts[m_iCurrCurve].end()) {
+			if (m_isvCurrCtrlPts[m_iCurrCurve].count(iClosestCtrlPt) > 0) {
 				// the point is one of the currently selected points. do nothing
 				return;
 			}
 			else {
 				deselectCtrlPts();
 				// select the control point
-				m_ivvCurrCtrlPts[m_iCurrCurve].push_back(iClosestCtrlPt);
+				m_isvCurrCtrlPts[m_iCurrCurve].insert(iClosestCtrlPt);
 				return;
 			}
 		}
@@ -589,9 +777,7 @@ void GraphWidget::selectAddCtrlPt(const int iMouseX, const int iMouseY)
 			if (fabs(ptCtrlPtInWindowCoord.x - ptMouse.x) * 2 <= PICK_WINDOW_SIZE &&
 				fabs(ptCtrlPtInWindowCoord.y - ptMouse.y) * 2 <= PICK_WINDOW_SIZE) {
 
-				if (std::find(m_ivvCurrCtrlPts[iCurve].begin(), 
-					m_ivvCurrCtrlPts[iCurve].end(), 
-					iClosestCtrlPt) != m_ivvCurrCtrlPts[iCurve].end()) {
+				if (m_isvCurrCtrlPts[iCurve].count(iClosestCtrlPt) > 0) {
 					// the point is one of the currently selected points. do nothing
 					return;
 				}
@@ -602,8 +788,9 @@ void GraphWidget::selectAddCtrlPt(const int iMouseX, const int iMouseY)
 		m_pcrvvCurves[m_iCurrCurve]->addControlPoint(ptMouseInCurveCoord);
 		Point ptDummy;
 		deselectCtrlPts();
-		m_ivvCurrCtrlPts[m_iCurrCurve].push_back(
-			m_pcrvvCurves[m_iCurrCurve]->getClosestControlPoint(ptMouseInCurveCoord, ptDummy));
+		int iNewCtrlPt = m_pcrvvCurves[m_iCurrCurve]->getClosestControlPoint(ptMouseInCurveCoord, ptDummy);
+		m_isvCurrCtrlPts[m_iCurrCurve].insert(iNewCtrlPt);
+		m_ejJournal.record(pointDelta(EditDelta::kInsertPoint, m_iCurrCurve, iNewCtrlPt, ptDummy));
 	}
 }
 
@@ -620,6 +807,10 @@ void GraphWidget::removeCtrlPt(const int iMouseX, const int iMouseY)
 
 		if (fabs(ptCtrlPtInWindowCoord.x - ptMouse.x) * 2 <= PICK_WINDOW_SIZE &&
 			fabs(ptCtrlPtInWindowCoord.y - ptMouse.y) * 2 <= PICK_WINDOW_SIZE) {
+			if (m_pcrvvCurves[m_iCurrCurve]->controlPointCount() > 2) {
+				m_ejJournal.beginStep();
+				m_ejJournal.record(pointDelta(EditDelta::kRemovePoint, m_iCurrCurve, iClosestCtrlPt, ptCtrlPt));
+			}
 			m_pcrvvCurves[m_iCurrCurve]->removeControlPoint(iClosestCtrlPt);
 			deselectCtrlPts();
 		}
@@ -634,6 +825,21 @@ void GraphWidget::dragCtrlPt(const int iMouseX, const int iMouseY)
 		ptMouse.x = min((float)(w() - 1), ptMouse.x);
 		ptMouse.y = max(0.0f, ptMouse.y); 
 		ptMouse.y = min((float)(h() - 1), ptMouse.y);
+
+		// where the dragged points started, for the journal
+		if (m_edvDrag.empty()) {
+			for (int i = 0; i < m_ivActiveCurves.size(); ++i) {
+				int iCurve = m_ivActiveCurves[i];
+				for (int_set::const_iterator it = m_isvCurrCtrlPts[iCurve].begin(); 
+					it != m_isvCurrCtrlPts[iCurve].end(); 
+					++it) {
+					Point ptCtrlPt;
+					m_pcrvvCurves[iCurve]->getControlPoint(*it, ptCtrlPt);
+					m_edvDrag.push_back(pointDelta(EditDelta::kMovePoint, iCurve, *it, ptCtrlPt));
+				}
+			}
+		}
+
 		for (int i = 0; i < m_ivActiveCurves.size(); ++i) {
 			int iCurve = m_ivActiveCurves[i];
 
@@ -643,7 +849,7 @@ void GraphWidget::dragCtrlPt(const int iMouseX, const int iMouseY)
 
 			ptMouseInCurveCoord.y - ptDragStartInCurveCoord.y);
 
-			m_pcrvvCurves[iCurve]->moveControlPoints(m_ivvCurrCtrlPts[iCurve], ptOffset,
+			m_pcrvvCurves[iCurve]->moveControlPoints(m_isvCurrCtrlPts[iCurve], ptOffset,
 				m_cdvCurveDomains[iCurve].minimum(), m_cdvCurveDomains[iCurve].maximum());
 		}
 
@@ -651,10 +857,27 @@ void GraphWidget::dragCtrlPt(const int iMouseX, const int iMouseY)
 	}
 }
 
+void GraphWidget::endDragCtrlPt()
+{
+	for (int i = 0; i < m_edvDrag.size(); ++i) {
+		EditDelta& edDelta = m_edvDrag[i];
+		Point ptCtrlPt;
+		m_pcrvvCurves[edDelta.iTarget]->getControlPoint(edDelta.iIndex, ptCtrlPt);
+
+		if (ptCtrlPt.x != edDelta.fvValues[0] || ptCtrlPt.y != edDelta.fvValues[1]) {
+			edDelta.fvValues[2] = ptCtrlPt.x;
+			edDelta.fvValues[3] = ptCtrlPt.y;
+			m_ejJournal.record(edDelta);
+		}
+	}
+
+	m_edvDrag.clear();
+}
+
 void GraphWidget::deselectCtrlPts()
 {
-	for (int i = 0; i < m_ivvCurrCtrlPts.size(); ++i)
-		m_ivvCurrCtrlPts[i].clear();
+	for (int i = 0; i < m_isvCurrCtrlPts.size(); ++i)
+		m_isvCurrCtrlPts[i].clear();
 }
 
 void GraphWidget::startSelection(const int iMouseX, const int iMouseY)
@@ -762,21 +985,21 @@ void GraphWidget::endCtrlPtSelection(const int iMouseX, const int iMouseY)
 
 	if (m_rectSelectionRect.width() > 0.0f && m_rectSelectionRect.height() > 0.0f) {
 		if (m_ivActiveCurves.size() > 0) {
+			int_vector ivCtrlPts;
 			for (int i = 0; i < m_ivActiveCurves.size(); ++i) {
 				int iCurve = m_ivActiveCurves[i];
 
-				for (int iCtrlPt = 0; iCtrlPt < m_pcrvvCurves[iCurve]->controlPointCount(); ++iCtrlPt) {
-					Point ptCtrlPtWndCoord, ptCtrlPt;
-					m_pcrvvCurves[iCurve]->getControlPoint(iCtrlPt, ptCtrlPt);
-					ptCtrlPtWndCoord = curveToWindow(iCurve, ptCtrlPt);
-
-					if (ptCtrlPtWndCoord.x >= m_rectSelectionRect.left() && 
-						ptCtrlPtWndCoord.x <= m_rectSelectionRect.right() &&
-						ptCtrlPtWndCoord.y <= m_rectSelectionRect.top() &&
-						ptCtrlPtWndCoord.y >= m_rectSelectionRect.bottom()) {
-						m_ivvCurrCtrlPts[iCurve].push_back(iCtrlPt);
-					}
-				}
+				// the corners in curve coordinates, where y runs the other way
+				Point ptCorner0 = windowToCurve(iCurve, 
+					Point(m_rectSelectionRect.left(), m_rectSelectionRect.bottom()));
+				Point ptCorner1 = windowToCurve(iCurve, 
+					Point(m_rectSelectionRect.right(), m_rectSelectionRect.top()));
+				Point ptMin(min(ptCorner0.x, ptCorner1.x), min(ptCorner0.y, ptCorner1.y));
+				Point ptMax(max(ptCorner0.x, ptCorner1.x), max(ptCorner0.y, ptCorner1.y));
+
+				ivCtrlPts.clear();
+				m_pcrvvCurves[iCurve]->getControlPointsInBox(ptMin, ptMax, ivCtrlPts);
+				m_isvCurrCtrlPts[iCurve].insert(ivCtrlPts.begin(), ivCtrlPts.end());
 			}
 		}
 	}
@@ -817,6 +1040,7 @@ void GraphWidget::activateCurve(int iCurve, bool bActive)
 		}
 
 		if (bActive) {
+			loadPendingCurve(iCurve);
 			std::vector<int>::iterator it = std::find(m_ivActiveCurves.begin(), m_ivActiveCurves.end(), iCurve);
 			if (it == m_ivActiveCurves.end()) {
 				m_ivActiveCurves.push_back(iCurve);
@@ -840,6 +1064,7 @@ void GraphWidget::activateCurve(int iCurve, bool bActive)
 int GraphWidget::currCurveWrap() const
 {
 	if (m_iCurrCurve >= 0) {
+		loadPendingCurve(m_iCurrCurve);
 		bool bWrap = m_pcrvvCurves[m_iCurrCurve]->wrap();
 		return bWrap ? 1 : 0;
 	}
@@ -850,29 +1075,170 @@ int GraphWidget::currCurveWrap() const
 void GraphWidget::currCurveWrap(bool bWrap)
 {
 	if (m_iCurrCurve >= 0) {
+		loadPendingCurve(m_iCurrCurve);
+		if (bWrap != m_pcrvvCurves[m_iCurrCurve]->wrap()) {
+			EditDelta edDelta;
+			edDelta.byKind = EditDelta::kWrap;
+			edDelta.iTarget = m_iCurrCurve;
+			edDelta.iIndex = 0;
+			edDelta.ivValues[0] = !bWrap;
+			edDelta.ivValues[1] = bWrap;
+			m_ejJournal.beginStep();
+			m_ejJournal.record(edDelta);
+		}
 		m_pcrvvCurves[m_iCurrCurve]->wrap(bWrap);
 	}
 }
 
 void GraphWidget::wrapCurve(int iCurve, bool bWrap)
 {
+	loadPendingCurve(iCurve);
 	m_pcrvvCurves[iCurve]->wrap(bWrap);
 }
 
+bool GraphWidget::undo()
+{
+	return m_ejJournal.undo(applyJournalEdits, this);
+}
+
+bool GraphWidget::redo()
+{
+	return m_ejJournal.redo(applyJournalEdits, this);
+}
+
+void GraphWidget::applyJournalEdits(const EditDelta* pedDeltas, const int iCount, 
+									const bool bUndo, void* pvWidget)
+{
+	((GraphWidget*)pvWidget)->applyEdits(pedDeltas, iCount, bUndo);
+}
+
+void GraphWidget::applyEdits(const EditDelta* pedDeltas, const int iCount, const bool bUndo)
+{
+	// the selected control points may have been renumbered
+	deselectCtrlPts();
+
+	int i = 0;
+	while (i < iCount) {
+		const EditDelta& edDelta = pedDeltas[i];
+		Curve* pcrvCurve = m_pcrvvCurves[edDelta.iTarget];
+
+		switch (edDelta.byKind) {
+		case EditDelta::kMovePoint:
+			if (bUndo)
+				pcrvCurve->setControlPoint(edDelta.iIndex, Point(edDelta.fvValues[0], edDelta.fvValues[1]));
+			else
+				pcrvCurve->setControlPoint(edDelta.iIndex, Point(edDelta.fvValues[2], edDelta.fvValues[3]));
+			++i;
+			break;
+
+		case EditDelta::kInsertPoint:
+			if (bUndo)
+				pcrvCurve->removeControlPoint2(edDelta.iIndex);
+			else
+				pcrvCurve->addControlPoint(Point(edDelta.fvValues[0], edDelta.fvValues[1]));
+			++i;
+			break;
+
+		case EditDelta::kRemovePoint:
+			// a run of removals from one curve is put back, or taken out
+			// again, with a single merge
+			pcrvCurve->beginEdit();
+			for (; i < iCount && pedDeltas[i].byKind == EditDelta::kRemovePoint && 
+				pedDeltas[i].iTarget == edDelta.iTarget; ++i) {
+				if (bUndo) {
+					Point ptCtrlPt(pedDeltas[i].fvValues[0], pedDeltas[i].fvValues[1]);
+					pcrvCurve->insertMany(&ptCtrlPt, 1);
+				}
+				else
+					pcrvCurve->removeMany(&pedDeltas[i].iIndex, 1);
+			}
+			pcrvCurve->commit();
+			break;
+
+		case EditDelta::kCurveType:
+			curveType(edDelta.iTarget, edDelta.ivValues[bUndo ? 0 : 1]);
+			++i;
+			break;
+
+		case EditDelta::kWrap:
+			pcrvCurve->wrap(edDelta.ivValues[bUndo ? 0 : 1] != 0);
+			++i;
+			break;
+
+		default:
+			++i;
+			break;
+		}
+	}
+}
+
 void GraphWidget::invalidateAllCurves()
 {
 	for (int i = 0; i < m_pcrvvCurves.size(); ++i)
 		m_pcrvvCurves[i]->invalidate();
 }
 
+int GraphWidget::reduceActiveCurveKeys(const float fTolerance)
+{
+	int iRemoved = 0;
+	int_vector ivRemovals;
+
+	m_ejJournal.beginStep();
+	for (int i = 0; i < m_ivActiveCurves.size(); ++i) {
+		int iCurve = m_ivActiveCurves[i];
+		loadPendingCurve(iCurve);
+
+		Curve* pcrvCurve = m_pcrvvCurves[iCurve];
+		pcrvCurve->findReducibleKeys(fTolerance * m_cdvCurveDomains[iCurve].mag(), ivRemovals);
+		if (ivRemovals.empty())
+			continue;
+
+		const std::vector<Point>& ptvCtrlPts = pcrvCurve->controlPoints();
+		for (int j = 0; j < ivRemovals.size(); ++j) {
+			m_ejJournal.record(pointDelta(EditDelta::kRemovePoint, iCurve, 
+				ivRemovals[j], ptvCtrlPts[ivRemovals[j]]));
+		}
+
+		pcrvCurve->removeMany(&ivRemovals[0], ivRemovals.size());
+		iRemoved += ivRemovals.size();
+	}
+
+	// the selected control points may be gone or renumbered
+	if (iRemoved > 0)
+		deselectCtrlPts();
+
+	return iRemoved;
+}
+
 const Curve* GraphWidget::curve(int iCurve) const
 {
+	// a curve of an .anib script is read the first time it is sampled
+	loadPendingCurve(iCurve);
+	return m_pcrvvCurves[iCurve];
+}
+
+const Curve* GraphWidget::sampledCurve(int iCurve) const
+{
+	if (!constantPendingCurve(iCurve))
+		loadPendingCurve(iCurve);
 	return m_pcrvvCurves[iCurve];
 }
 
-void GraphWidget::drawActiveCurves() const
+bool GraphWidget::constantPendingCurve(int iCurve) const
 {
+	if (!m_apScript.pending(iCurve))
+		return false;
+
+	const AnibCurveEntry& aceCurve = m_apScript.file().curve(iCurve);
+	return aceCurve.uiPointCount > 0 && aceCurve.fMinY == aceCurve.fMaxY;
+}
+
+void GraphWidget::drawActiveCurves(bool bEditedCurves) const
+{
+	// the curves with selected control points are the edited ones
 	for (int i = m_ivActiveCurves.size() - 1; i >= 0; --i) {
+		if (m_isvCurrCtrlPts[m_ivActiveCurves[i]].empty() == bEditedCurves)
+			continue;
 		int iColor = i % CURVE_COLOR_COUNT;
 		drawCurve(m_ivActiveCurves[i], iColor);
 	}
@@ -899,14 +1265,18 @@ void GraphWidget::drawCurve(int iCurve, int iColor) const
 		m_flcCurrCurve = flcvColors[iColor];
 		glLineWidth(3.0);
 	}
-	m_pcrvvCurves[iCurve]->drawEvaluatedCurveSegments();
+	loadPendingCurve(iCurve);
+	m_pcrvvCurves[iCurve]->drawEvaluatedCurveSegments(
+		m_fEndTime * m_rectCurrViewport.left(), m_fEndTime * m_rectCurrViewport.right(), w());
 	if (iCurve == m_iCurrCurve)
 		glLineWidth(1.0);
 	m_pcrvvCurves[iCurve]->drawControlPoints();
 
 	glColor3f(1.0f, 1.0f, 1.0f); // white
-	for (int i = 0; i < m_ivvCurrCtrlPts[iCurve].size(); ++i) {
-		m_pcrvvCurves[iCurve]->drawControlPoint(m_ivvCurrCtrlPts[iCurve][i]);
+	for (int_set::const_iterator it = m_isvCurrCtrlPts[iCurve].begin(); 
+		it != m_isvCurrCtrlPts[iCurve].end(); 
+		++it) {
+		m_pcrvvCurves[iCurve]->drawControlPoint(*it);
 	}
 
 
@@ -1028,6 +1398,15 @@ Point GraphWidget::windowToCurve(int iCurve, const Point& ptWindow) const
 
 bool GraphWidget::saveScript(const char* szFileName) const
 {
+	// the file being written may be the one the pending curves are read from
+	for (int i = 0; i < m_pcrvvCurves.size(); ++i)
+		loadPendingCurve(i);
+
+	if (AnibFile::isAnibFileName(szFileName)) {
+		return AnibFile::save(szFileName, m_fEndTime, &m_pcrvvCurves[0],
+			&m_ivCurveTypes[0], m_pcrvvCurves.size());
+	}
+
 	std::ofstream ofsFile;
 
 	ofsFile.open(szFileName, std::ios::out);
@@ -1048,38 +1427,157 @@ bool GraphWidget::saveScript(const char* szFileName) const
 
 bool GraphWidget::loadScript(const char* szFileName)
 {
-	std::ifstream ifsFile;
+	if (AnibFile::isAnibFileName(szFileName)) {
+		if (!loadBinaryScript(szFileName))
+			return false;
 
-	ifsFile.open(szFileName, std::ios::in);
-	if (!ifsFile.fail()) {
-		int iCurveCount;
-		float fEndTime;
+		m_ejJournal.clear();
+		return true;
+	}
 
-		ifsFile >> fEndTime;
-		if (fEndTime <= 0.0f)
-			return false;
-		endTime(fEndTime);
+	std::vector<char> cvText;
+	if (!TextScanner::loadFile(szFileName, cvText)) {
+		m_strLoadError = "cannot read the file";
+		return false;
+	}
 
-		ifsFile >> iCurveCount;
+	TextScanner tsScanner(cvText.empty() ? NULL : &cvText[0],
+		cvText.empty() ? NULL : &cvText[0] + cvText.size());
+	int iCurveCount;
+	float fEndTime;
 
-		if (iCurveCount != m_pcrvvCurves.size()) {
-#ifdef _DEBUG
-			assert(0);
-#endif // _DEBUG
+	if (!tsScanner.readFloat(fEndTime) || fEndTime <= 0.0f) {
+		tsScanner.fail("a positive end time");
+		m_strLoadError = tsScanner.error();
+		return false;
+	}
+
+	if (!tsScanner.readInt(iCurveCount) || iCurveCount != m_pcrvvCurves.size()) {
+		tsScanner.fail("the number of curves of this model");
+		m_strLoadError = tsScanner.error();
+		return false;
+	}
+
+	// the whole script is parsed before any curve is touched, so that a
+	// malformed one leaves the curves, and the script they may still be
+	// read from, as they were
+	std::vector<int> ivTypes(iCurveCount);
+	std::vector<Curve> crvvParsed(iCurveCount);
+	for (int i = 0; i < iCurveCount; ++i) {
+		if (!tsScanner.readInt(ivTypes[i]) || ivTypes[i] < 0 || ivTypes[i] >= CURVE_TYPE_COUNT) {
+			tsScanner.fail("a curve type");
+			break;
+		}
+		if (!crvvParsed[i].fromText(tsScanner))
+			break;
+	}
+
+	if (tsScanner.failed()) {
+		m_strLoadError = tsScanner.error();
+		return false;
+	}
+
+	m_apScript.close();
+	endTime(fEndTime);
+	for (int i = 0; i < iCurveCount; ++i) {
+		const std::vector<Point>& ptvCtrlPts = crvvParsed[i].controlPoints();
+		curveType(i, ivTypes[i]);
+		m_pcrvvCurves[i]->setControlPoints(&ptvCtrlPts[0], ptvCtrlPts.size(),
+			crvvParsed[i].maxX(), crvvParsed[i].wrap());
+	}
+
+	m_ejJournal.clear();
+	return true;
+}
+
+bool GraphWidget::loadBinaryScript(const char* szFileName)
+{
+	// opening the prefetcher closes the script the curves may still be
+	// read from, so the new one is checked first
+	{
+		AnibFile afCheck;
+		if (!afCheck.open(szFileName)) {
+			m_strLoadError = "not a valid .anib file";
+			return false;
+		}
+		if (afCheck.curveCount() != m_pcrvvCurves.size()) {
+			m_strLoadError = "the script is for a model with another number of curves";
 			return false;
 		}
+	}
 
-		for (int i = 0; i < iCurveCount; ++i) {
-			int iType;
-			ifsFile >> iType;
-			curveType(i, iType);
-			m_pcrvvCurves[i]->fromStream(ifsFile);
+	// only the curve table is read here; the points follow as the curves
+	// are needed, or as the prefetcher gets to them
+	if (!m_apScript.open(szFileName)) {
+		m_strLoadError = "not a valid .anib file";
+		return false;
+	}
+
+	const AnibFile& afFile = m_apScript.file();
+	if (afFile.curveCount() != m_pcrvvCurves.size()) {
+		m_apScript.close();
+		m_strLoadError = "the script is for a model with another number of curves";
+		return false;
+	}
+
+	m_bDamagedCurve = false;
+	endTime(afFile.endTime());
+
+	for (int i = 0; i < afFile.curveCount(); ++i) {
+		int iType = afFile.curve(i).iType;
+		curveType(i, (iType >= 0 && iType < CURVE_TYPE_COUNT) ? iType : CURVE_TYPE_LINEAR);
+
+		// a constant curve is only read once it is activated; until then
+		// a single point at its y evaluates the same, up to rounding
+		if (constantPendingCurve(i)) {
+			Point ptConstant(0.0f, afFile.curve(i).fMinY);
+			m_pcrvvCurves[i]->setControlPoints(&ptConstant, 1, m_fEndTime, afFile.curve(i).uiWrap != 0);
 		}
+	}
 
-		return true;
+	// the visible curves are needed right away
+	for (int i = 0; i < m_ivActiveCurves.size(); ++i)
+		loadPendingCurve(m_ivActiveCurves[i]);
+
+	return true;
+}
+
+bool GraphWidget::takeDamagedCurve()
+{
+	bool bDamaged = m_bDamagedCurve;
+	m_bDamagedCurve = false;
+	return bDamaged;
+}
+
+void GraphWidget::loadPendingCurve(int iCurve) const
+{
+	if (!m_apScript.pending(iCurve))
+		return;
+
+	std::vector<Point> ptvPoints;
+	if (!m_apScript.take(iCurve, ptvPoints)) {
+		fprintf(stderr, "ERROR: the points of curve %d of the script are damaged\n", iCurve);
+
+		// nothing of the last script may be left in the curve
+		Point ptvFlat[2] = {
+			Point(m_fEndTime * (1.0f / 3.0f), m_fvStartValues[iCurve]),
+			Point(m_fEndTime * (2.0f / 3.0f), m_fvStartValues[iCurve])
+		};
+		m_pcrvvCurves[iCurve]->setControlPoints(ptvFlat, 2, m_fEndTime, false);
+
+		char szError[128];
+		_snprintf(szError, 128, "the points of curve %d of the script are damaged", iCurve);
+		szError[127] = 0;
+		m_strLoadError = szError;
+		m_bDamagedCurve = true;
+		return;
 	}
 
-	return false;
+	const AnibCurveEntry& aceCurve = m_apScript.file().curve(iCurve);
+	m_pcrvvCurves[iCurve]->setControlPoints(ptvPoints.empty() ? NULL : &ptvPoints[0],
+		ptvPoints.size(), aceCurve.fMaxX, aceCurve.uiWrap != 0);
+	// the end time may have changed since the script was opened
+	m_pcrvvCurves[iCurve]->maxX(m_fEndTime);
 }
 
 Point GraphWidget::windowToGrid( Point p ) {
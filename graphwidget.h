@@ -7,6 +7,7 @@
 #include <FL/Fl_Menu_Item.H>
 #include <string>
 #include <vector>
+#include <unordered_set>
 #ifdef _DEBUG
 #include <assert.h>
 #endif // _DEBUG
@@ -15,6 +16,8 @@
 #include "point.h"
 #include "curve.h"
 #include "curveevaluator.h"
+#include "anibfile.h"
+#include "editjournal.h"
 
 #define CURVE_TYPE_LINEAR 0
 #define CURVE_TYPE_BSPLINE 1
@@ -73,6 +76,7 @@ protected:
 };
 
 typedef std::vector<int> int_vector;
+typedef std::unordered_set<int> int_set;
 
 class GraphWidget : public Fl_Gl_Window
 {
@@ -101,16 +105,38 @@ public:
 	int currCurveWrap() const;
 	void currCurveWrap(bool bWrap);
 	void invalidateAllCurves();
+	// removes the keys the active curves can do without, keeping each
+	// curve within fTolerance of its range of where it was. Returns how
+	// many keys were removed.
+	int reduceActiveCurveKeys(const float fTolerance);
 	// note that this value is evaluated lazily (it's only updated
 	// after a redraw.
 	Fl_Color currCurveColor() const { return m_flcCurrCurve; }
 
 	const Curve* curve(int iCurve) const;
+	// the curve to sample for its control's value. Unlike curve(), it
+	// does not read a constant curve of an .anib script, whose stand-in
+	// point gives the same values.
+	const Curve* sampledCurve(int iCurve) const;
+	// names ending with .anib are saved and loaded in the binary format,
+	// anything else as text
 	bool saveScript(const char* szFileName) const;
 	bool loadScript(const char* szFileName);
+	// why the last loadScript failed, with the line for text scripts, or
+	// which curve of an .anib script turned out to be damaged when it was
+	// read later on
+	const std::string& loadError() const { return m_strLoadError; }
+	// true once after a curve of an .anib script was found damaged; the
+	// curve is then flat at its starting value
+	bool takeDamagedCurve();
 
 	void zoomAll();
 
+	// undo and redo the last curve edit, also done with ctrl+z and ctrl+y;
+	// false if there is none
+	bool undo();
+	bool redo();
+
 	Point windowToGrid( Point p ) ;
 	Point gridToWindow( Point p ) ;
 
@@ -138,14 +164,47 @@ protected:
 	std::vector<int> m_ivCurveTypes;
 	CurveEvaluator** m_ppceCurveEvaluators;
 	std::vector<int> m_ivActiveCurves;
-	std::vector<int_vector> m_ivvCurrCtrlPts;
+	// the selected control points of each curve
+	std::vector<int_set> m_isvCurrCtrlPts;
 	float m_fEndTime;
 	float m_fCurrTime;
+	mutable std::string m_strLoadError;
+	mutable bool m_bDamagedCurve;
+	// the value each curve started at, for a curve that cannot be read
+	std::vector<float> m_fvStartValues;
+	// the .anib script whose curves are still being read
+	mutable AnibPrefetcher m_apScript;
+	// the undo history of the curve edits, and where the control points
+	// being dragged started
+	EditJournal m_ejJournal;
+	std::vector<EditDelta> m_edvDrag;
+
+	// the grid display list and the view it was compiled for
+	mutable unsigned int m_uiGridList;
+	mutable float m_fGridLeftTime;
+	mutable float m_fGridRightTime;
+	mutable int m_iGridWidth;
+	mutable int m_iGridHeight;
+	// the background, grid and unedited curves as last drawn, with what
+	// they were drawn for
+	mutable unsigned int m_uiLayerTexture;
+	mutable int m_iLayerTextureWidth;
+	mutable int m_iLayerTextureHeight;
+	mutable std::vector<int> m_ivLayerKey;
+	mutable Rect m_rectLayerViewport;
+	mutable float m_fLayerEndTime;
 
 	void draw();
 	int handle(int event);
 
-	void drawActiveCurves() const;
+	// either the curves with selected control points or the others
+	void drawActiveCurves(bool bEditedCurves) const;
+	void drawGrid() const;
+	// what the cached layer depends on besides the view
+	void layerKey(std::vector<int>& ivKey) const;
+	// false if the cached layer is out of date
+	bool drawCachedLayer(const std::vector<int>& ivKey) const;
+	void cacheLayer(const std::vector<int>& ivKey) const;
 	void drawCurve(int iCurve, int iColor) const;
 	void drawSelectionRect() const;
 	void drawZoomSelectionMap() const;
@@ -155,6 +214,8 @@ protected:
 	void selectAddCtrlPt(const int iMouseX, const int iMouseY);
 	void removeCtrlPt(const int iMouseX, const int iMouseY);
 	void dragCtrlPt(const int iMouseX, const int iMouseY);
+	// records the drag since the mouse went down
+	void endDragCtrlPt();
 	void deselectCtrlPts();
 	void startSelection(const int iMouseX, const int iMouseY);
 	void doSelection(const int iMouseX, const int iMouseY);
@@ -169,6 +230,16 @@ protected:
 	void doPan(const int iMouseDX, const int iMouseDY);
 
 	void curveType(int iCurve, int iCurveType);
+	static void applyJournalEdits(const EditDelta* pedDeltas, const int iCount, 
+		const bool bUndo, void* pvWidget);
+	void applyEdits(const EditDelta* pedDeltas, const int iCount, const bool bUndo);
+	bool loadBinaryScript(const char* szFileName);
+	// sets the points of a curve of the open .anib script, if it has not
+	// been read yet
+	void loadPendingCurve(int iCurve) const;
+	// true if the curve is still to be read from the .anib script and
+	// all its points have the same y
+	bool constantPendingCurve(int iCurve) const;
 
 	Point curveToWindow(int iCurve, const Point& ptCurve) const;
 	Point windowToCurve(int iCurve, const Point& ptWindow) const;
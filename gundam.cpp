@@ -12,12 +12,13 @@
 #include "camera.h"
 #include <iostream>
 #include "particlesystem.h"
+#include "profiler.h"
 using namespace std;
 
 #define PI 3.14159265
 
 Mat4f getModelViewMatrix();
-void SpawnParticles(Mat4f CameraTransforms);
+void SpawnParticles(Camera* camera);
 
 
 //draw bezier curve and rotate it around specific axis
@@ -247,6 +248,7 @@ ModelerView* createGundamModel(int x, int y, int w, int h, char *label)
 // method of ModelerView to draw out GundamModel
 void GundamModel::draw()
 {
+	PROFILE_SCOPE("model draw");
 
 	//m_camera->frameAll();
 	// This call takes care of a lot of the nasty projection 
@@ -262,9 +264,6 @@ void GundamModel::draw()
 	setDiffuseColor(COLOR_YELLOW);
 	//	setSpecularColor(0.8f, 0.5f, 0.0f);
 
-	// Get the camera matrix
-	Mat4f CameraMatrix = getModelViewMatrix();
-
 	// Start drawing the Gundam model
 	glPushMatrix();
 	glTranslated(VAL(XPOS), VAL(YPOS), VAL(ZPOS));
@@ -291,7 +290,7 @@ void GundamModel::draw()
 		VAL(HEAD2) ? drawHead2() : drawHead();
 		glPushMatrix();
 		glTranslated(headSize[0] / 2, headSize[1], 0.0);
-		SpawnParticles(CameraMatrix);
+		SpawnParticles(m_camera);
 		glPopMatrix();
 		glTranslated(0.0, headSize[1] + headSize[1] / 6, 0.0);
 		glPopMatrix();
@@ -310,7 +309,7 @@ void GundamModel::draw()
 		VAL(SHOULDER2) ? drawRightShoulder2() : drawRightShoulder();
 		glPushMatrix();
 		glTranslated(-rightShoulderSize[0] / 2, rightShoulderSize[1]/2, 0.0);
-		SpawnParticles(CameraMatrix);
+		SpawnParticles(m_camera);
 		glPopMatrix();
 		//draw right upper arm
 		if (VAL(DETAIL) >= 2){
@@ -355,7 +354,7 @@ void GundamModel::draw()
 		VAL(SHOULDER2) ? drawLeftShoulder2() : drawLeftShoulder();
 		glPushMatrix();
 		glTranslated(leftShoulderSize[0] / 2, leftShoulderSize[1] / 2, 0.0);
-		SpawnParticles(CameraMatrix);
+		SpawnParticles(m_camera);
 		glPopMatrix();
 		//draw left upper arm
 		if (VAL(DETAIL) >= 2){
@@ -460,6 +459,7 @@ void GundamModel::draw()
 	}
 	glPopMatrix();
 
+	endDraw();
 }
 
 //OpenGl command to draw upper body
@@ -1432,27 +1432,27 @@ Mat4f getModelViewMatrix() {
 	return matMV.transpose();
 }
 
-void SpawnParticles (Mat4f CameraMatrix) {
+void SpawnParticles (Camera* camera) {
+	// the emitter in world coordinates, through the camera's cached
+	// inverse rather than inverting the modelview matrix each time
 	Mat4f CurrentModelViewMatrix = getModelViewMatrix();
-	CurrentModelViewMatrix.transpose();
-	Mat4f WorldMatrix = CameraMatrix.inverse() * CurrentModelViewMatrix;
-	Vec4f WorldPoint = WorldMatrix * (Vec4f(0, 0, 0, 1));
+	Vec4f EyePoint = CurrentModelViewMatrix * (Vec4f(0, 0, 0, 1));
+	Vec4f WorldPoint = camera->getInverseViewingTransform() * EyePoint;
 	ParticleSystem* ps = ModelerApplication::Instance()->GetParticleSystem();
 	float t = ModelerApplication::Instance()->GetTime();
 
-	// apply the inverse transforation matrix
-	float* glTransformationMatrix = new float[16];
-	WorldMatrix.inverse().getGLMatrix(glTransformationMatrix);
-	glMultMatrixf(glTransformationMatrix);
+	// the particles live in world coordinates, so go back to the
+	// camera's transform and move to the emitter from there
+	glLoadIdentity();
+	camera->applyViewingTransform();
 	glTranslated(WorldPoint[0], WorldPoint[1], WorldPoint[2]);
 	if (ps) {
 		ps->computeForcesAndUpdateParticles(t);
 		ps->drawParticles(t);
 	}
-	delete [] glTransformationMatrix;
 }
 
-int main()
+int main(int argc, char** argv)
 {
 	// Initialize the controls
 	// Constructor is ModelerControl(name, minimumvalue, maximumvalue, 
@@ -1496,5 +1496,5 @@ int main()
 	ParticleSystem* ps = new ParticleSystem();
 	ModelerApplication::Instance()->SetParticleSystem(ps);
 	ModelerApplication::Instance()->Init(&createGundamModel, controls, NUMCONTROLS);
-	return ModelerApplication::Instance()->Run();
+	return ModelerApplication::Instance()->Run(argc, argv);
 }
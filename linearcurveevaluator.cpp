@@ -1,14 +1,14 @@
 #include "LinearCurveEvaluator.h"
 #include <assert.h>
 
-void LinearCurveEvaluator::evaluateCurve(const std::vector<Point>& ptvCtrlPts, 
+void LinearCurveEvaluator::evaluateCurve(const Point* pptCtrlPts, 
+										 const int iCtrlPtCount,
 										 std::vector<Point>& ptvEvaluatedCurvePts, 
 										 const float& fAniLength, 
-										 const bool& bWrap) const
+										 const bool& bWrap,
+										 CurveEvaluationScratch& scratch) const
 {
-	int iCtrlPtCount = ptvCtrlPts.size();
-
-	ptvEvaluatedCurvePts.assign(ptvCtrlPts.begin(), ptvCtrlPts.end());
+	ptvEvaluatedCurvePts.clear();
 
 	float x = 0.0;
 	float y1;
@@ -18,22 +18,25 @@ void LinearCurveEvaluator::evaluateCurve(const std::vector<Point>& ptvCtrlPts,
 		// xmax so that the slopes of the lines adjacent to the
 		// wraparound are equal.
 
-		if ((ptvCtrlPts[0].x + fAniLength) - ptvCtrlPts[iCtrlPtCount - 1].x > 0.0f) {
-			y1 = (ptvCtrlPts[0].y * (fAniLength - ptvCtrlPts[iCtrlPtCount - 1].x) + 
-				  ptvCtrlPts[iCtrlPtCount - 1].y * ptvCtrlPts[0].x) /
-				 (ptvCtrlPts[0].x + fAniLength - ptvCtrlPts[iCtrlPtCount - 1].x);
+		if ((pptCtrlPts[0].x + fAniLength) - pptCtrlPts[iCtrlPtCount - 1].x > 0.0f) {
+			y1 = (pptCtrlPts[0].y * (fAniLength - pptCtrlPts[iCtrlPtCount - 1].x) + 
+				  pptCtrlPts[iCtrlPtCount - 1].y * pptCtrlPts[0].x) /
+				 (pptCtrlPts[0].x + fAniLength - pptCtrlPts[iCtrlPtCount - 1].x);
 		}
 		else 
-			y1 = ptvCtrlPts[0].y;
+			y1 = pptCtrlPts[0].y;
 	}
 	else {
 		// if wrapping is off, make the first and last segments of
 		// the curve horizontal.
 
-		y1 = ptvCtrlPts[0].y;
+		y1 = pptCtrlPts[0].y;
     }
 
+	// the control points are kept sorted, so emitting them between the
+	// two endpoints keeps the output ordered
 	ptvEvaluatedCurvePts.push_back(Point(x, y1));
+	ptvEvaluatedCurvePts.insert(ptvEvaluatedCurvePts.end(), pptCtrlPts, pptCtrlPts + iCtrlPtCount);
 
 	/// set the endpoint based on the wrap flag.
 	float y2;
@@ -41,7 +44,10 @@ void LinearCurveEvaluator::evaluateCurve(const std::vector<Point>& ptvCtrlPts,
     if (bWrap)
 		y2 = y1;
     else
-		y2 = ptvCtrlPts[iCtrlPtCount - 1].y;
+		y2 = pptCtrlPts[iCtrlPtCount - 1].y;
 
 	ptvEvaluatedCurvePts.push_back(Point(x, y2));
+
+	scratch.ptvWrappedPts.clear();
+	mergeWrappedPoints(ptvEvaluatedCurvePts, scratch);
 }
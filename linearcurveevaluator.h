@@ -10,10 +10,12 @@
 class LinearCurveEvaluator : public CurveEvaluator
 {
 public:
-	void evaluateCurve(const std::vector<Point>& ptvCtrlPts, 
-		std::vector<Point>& ptvEvaluatedCurvePts, 
-		const float& fAniLength, 
-		const bool& bWrap) const;
+	void evaluateCurve(const Point* pptCtrlPts,
+		const int iCtrlPtCount,
+		std::vector<Point>& ptvEvaluatedCurvePts,
+		const float& fAniLength,
+		const bool& bWrap,
+		CurveEvaluationScratch& scratch) const;
 };
 
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "modelerview.h"
 #include "modelerui.h"
 #include "camera.h"
+#include "modelerglobals.h"
 
 #include <FL/Fl_Value_Slider.H>
 #include <FL/Fl_Box.H>
@@ -12,6 +13,9 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#ifdef _DEBUG
+#include <assert.h>
+#endif // _DEBUG
 
 // CLASS ModelerControl METHODS
 
@@ -68,6 +72,7 @@ void ModelerApplication::Init(ModelerViewCreator_f createView,
 
 	m_animating   = false;
 	m_numControls = numControls;
+	m_tidDraw     = std::this_thread::get_id();
 
 	DWORD dwBtnFaceColor = GetSysColor(COLOR_BTNFACE);
 
@@ -95,6 +100,13 @@ void ModelerApplication::Init(ModelerViewCreator_f createView,
 
 	ModelerView* modelerView = createView(0, 0, 100, 100 ,NULL);
 	m_ui->replaceModelerView(modelerView);
+
+	// the curves may read a value while the first values are copied out
+	float* pfValues = m_csControlValues.beginWrite(m_numControls);
+	for (i=0; i<m_numControls; i++)
+		pfValues[i] = controls[i].m_value;
+	m_csControlValues.publish();
+	PublishControlValues();
 }
 
 ModelerApplication::~ModelerApplication()
@@ -114,7 +126,6 @@ int ModelerApplication::Run()
     // Just tell FLTK to go for it.
    	Fl::visual( FL_RGB | FL_DOUBLE );
 	m_ui->show();
-	Fl::add_timeout(0, ModelerApplication::RedrawLoop, NULL);
 
 	// Automatically load animator.ani and animator.ani.cam if they exist
 	m_ui->autoLoadNPlay();
@@ -122,14 +133,56 @@ int ModelerApplication::Run()
 	return Fl::run();
 }
 
+int ModelerApplication::Run(int argc, char** argv)
+{
+	if (!BatchOptions::requested(argc, argv))
+		return Run();
+
+	if (m_numControls == -1)
+	{
+		fprintf(stderr, "ERROR: ModelerApplication must be initialized before Run()!\n");
+		return -1;
+	}
+
+	BatchOptions options;
+	if (!options.parse(argc, argv))
+		return -1;
+
+	return m_ui->renderBatch(options);
+}
+
 double ModelerApplication::GetControlValue(int controlNumber)
 {
-    return m_ui->controlValue(controlNumber);
+#ifdef _DEBUG
+	assert(controlNumber >= 0 && controlNumber < m_numControls);
+#endif // _DEBUG
+	// a draw indexes into the values it holds; 0 for a control the
+	// values do not have yet
+	if (m_cvDrawValues.held() && std::this_thread::get_id() == m_tidDraw) {
+		return controlNumber >= 0 && controlNumber < m_cvDrawValues.count() ?
+			m_cvDrawValues.values()[controlNumber] : 0.0;
+	}
+    return m_csControlValues.value(controlNumber, 0.0f);
 }
 
 void ModelerApplication::SetControlValue(int controlNumber, double value)
 {
     m_ui->controlValue(controlNumber, value);
+	// the model reads the values from the snapshot, so the new one is
+	// published here rather than left to the value changed callback
+	PublishControlValues();
+}
+
+void ModelerApplication::BeginDraw()
+{
+	if (std::this_thread::get_id() == m_tidDraw)
+		m_cvDrawValues.acquire(m_csControlValues);
+}
+
+void ModelerApplication::EndDraw()
+{
+	if (std::this_thread::get_id() == m_tidDraw)
+		m_cvDrawValues.release();
 }
 
 ParticleSystem *ModelerApplication::GetParticleSystem()
@@ -157,12 +210,41 @@ bool ModelerApplication::Animating()
 	return m_animating;
 }
 
+// Copies the control values out of the user interface for the frame
+// about to be drawn. Everything that changes a value, the time or the
+// curves ends up in ValueChangedCallback, which publishes them before
+// asking for the redraw.
+void ModelerApplication::PublishControlValues()
+{
+	// a draw that did not get to endDraw must not go on reading the
+	// values being replaced
+	m_cvDrawValues.release();
+
+	// the catmull-rom curves read the tension from the last values, so
+	// when it changes they are evaluated again with the new one, once
+	for (int iPass = 0; iPass < 2; ++iPass) {
+		float* pfValues = m_csControlValues.beginWrite(m_numControls);
+		m_ui->controlValues(pfValues);
+
+		bool bTensionChanged = TENSION < m_numControls &&
+			m_csControlValues.value(TENSION, pfValues[TENSION]) != pfValues[TENSION];
+
+		m_csControlValues.publish();
+
+		if (!bTensionChanged)
+			break;
+		m_ui->m_pwndGraphWidget->invalidateAllCurves();
+	}
+}
+
 void ModelerApplication::ValueChangedCallback()
 {
 
 	ModelerApplication *m_app = ModelerApplication::Instance();
 
 	ModelerUI *m_ui = m_app->m_ui;
+	m_app->PublishControlValues();
+
 	float currTime = m_ui->currTime();
 	float endTime = m_ui->endTime();
 	float playEndTime = m_ui->playEndTime();
@@ -201,13 +283,4 @@ void ModelerApplication::ValueChangedCallback()
 	m_ui->m_pwndModelerView->m_camera->update(currTime);
 
 	m_ui->redrawModelerView();
-}
-
-void ModelerApplication::RedrawLoop(void*)
-{
-	if (ModelerApplication::Instance()->m_animating)
-		ModelerApplication::Instance()->m_ui->redrawModelerView();
-
-	// 1/50 second update is good enough
-	Fl::add_timeout(0.025, ModelerApplication::RedrawLoop, NULL);
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 #define MODELERAPP_H
 
 #include "modelerview.h"
+#include "controlsnapshot.h"
+
+#include <thread>
 
 struct ModelerControl
 {
@@ -47,11 +50,21 @@ public:
 
     // Starts the application, returns when application is closed
 	int  Run();
+	// Same as Run(), except that a -batch command line renders the
+	// script's frames to disk and returns without showing the UI
+	int  Run(int argc, char** argv);
 
-    // Get and set slider values.
+    // Get and set slider values. The values read are those of the
+    // current frame, which stay the same until the next value change.
     double GetControlValue(int controlNumber);
     void   SetControlValue(int controlNumber, double value);
 
+	// ModelerView::draw and endDraw hold the control values for the
+	// length of a draw, so the values it reads come from one snapshot
+	// taken once
+	void BeginDraw();
+	void EndDraw();
+
 	// Get and set particle system
 	ParticleSystem *GetParticleSystem();
 	void SetParticleSystem(ParticleSystem *s);
@@ -77,8 +90,15 @@ private:
 	ModelerUI *m_ui;
 	int					  m_numControls;
 
+	// the control values the drawing and the curves read this frame
+	ControlSnapshot m_csControlValues;
+	void PublishControlValues();
+	// the values held by the draw going on, and the thread that draws,
+	// the only one that reads them
+	ControlSnapshot::View m_cvDrawValues;
+	std::thread::id m_tidDraw;
+
     static void ValueChangedCallback();
-	static void RedrawLoop(void*);
 
 	// Just a flag for updates
 	bool m_animating;
@@ -21,22 +21,29 @@
 #include <assert.h>
 #endif _DEBUG
 #include <string>
+#include <cstdio>
+#include <cstring>
+#include <math.h>
 #include <FL/fl_ask.h>
+#include <FL/gl.h>
 
 #include "modelerui.h"
 #include "camera.h"
+#include "profiler.h"
 
 using namespace std;
 
 inline void ModelerUI::cb_openAniScript_i(Fl_Menu_*, void*)
 {
-	char *szFileName = fl_file_chooser("Open Animation Script", "*.ani", NULL);
+	char *szFileName = fl_file_chooser("Open Animation Script", "*.{ani,anib}", NULL);
 	if (szFileName) {
 		if (openAniScript(szFileName)) {
 			// successfully opened
+			alertDamagedCurve();
 		}
 		else {
-			fl_alert("Sorry! I can't load the animation script!");
+			fl_alert("Sorry! I can't load the animation script!\n%s",
+				m_pwndGraphWidget->loadError().c_str());
 		}
 	}
 }
@@ -48,7 +55,7 @@ void ModelerUI::cb_openAniScript(Fl_Menu_* o, void* v)
 
 inline void ModelerUI::cb_saveAniScript_i(Fl_Menu_*, void*)
 {
-	char *szFileName = fl_file_chooser("Save Animation Script As", "*.ani", NULL);
+	char *szFileName = fl_file_chooser("Save Animation Script As", "*.{ani,anib}", NULL);
 	if (szFileName) {
 		string strFileName = szFileName;
 
@@ -110,6 +117,14 @@ inline void ModelerUI::cb_saveMovie_i(Fl_Menu_*, void*)
 		if (!stricmp(szExt, ".bmp"))
 			m_strMovieFileName = m_strMovieFileName.substr(0, m_strMovieFileName.length() - 4);
 
+		// a movie still being saved is finished first
+		if (m_bSaveMovie)
+			animate(false);
+
+		if (!m_meMovieExporter.begin(m_strMovieFileName.c_str(), "bmp", m_iFps)) {
+			fl_alert("Sorry! I can't save the movie to %s!", m_strMovieFileName.c_str());
+			return;
+		}
 		m_bSaveMovie = true;
 		m_iMovieFrameNum = 0;
 		m_psldrFPS->deactivate();
@@ -241,6 +256,29 @@ void ModelerUI::cb_aniLen(Fl_Menu_* o, void* v)
 	((ModelerUI*)(o->parent()->user_data()))->cb_aniLen_i(o,v);
 }
 
+inline void ModelerUI::cb_reduceKeys_i(Fl_Menu_*, void*) 
+{
+	const char* szTolerance = fl_input("Reduce the keys of the shown curves.\n"
+		"Tolerance (in percent of each curve's range)", "0.5");
+
+	if (szTolerance) {
+		float fTolerance = (float)atof(szTolerance);
+		if (fTolerance > 0.0f) {
+			int iRemoved = m_pwndGraphWidget->reduceActiveCurveKeys(fTolerance / 100.0f);
+			m_pwndGraphWidget->redraw();
+			// the curves changed, so the model is updated as after an edit
+			if (iRemoved > 0)
+				m_pwndGraphWidget->do_callback();
+			fl_message("%d keys were removed.", iRemoved);
+		}
+	}
+}
+
+void ModelerUI::cb_reduceKeys(Fl_Menu_* o, void* v) 
+{
+	((ModelerUI*)(o->parent()->user_data()))->cb_reduceKeys_i(o,v);
+}
+
 inline void ModelerUI::cb_fps_i(Fl_Slider*, void*) 
 {
 	fps(m_psldrFPS->value());
@@ -297,6 +335,7 @@ inline void ModelerUI::cb_browser_i(Fl_Browser*, void*)
 
 	redrawRulers();
 	activeCurvesChanged();
+	alertDamagedCurve();
 	// somehow we need to redraw the entire window so that
 	// the sliders will show up if we:
 	// 1. switch to tab immediately after the program starts
@@ -333,6 +372,7 @@ void ModelerUI::cb_tab(Fl_Tabs* o, void* v)
 
 inline void ModelerUI::cb_graphWidget_i(GraphWidget*, void*) 
 {
+	alertDamagedCurve();
 	activeCurvesChanged();
 	redrawRulers();
 	if (m_pcbfValueChangedCallback)
@@ -344,6 +384,18 @@ void ModelerUI::cb_graphWidget(GraphWidget* o, void* v)
 	((ModelerUI*)(o->user_data()))->cb_graphWidget_i(o,v);
 }
 
+inline void ModelerUI::cb_modelerView_i(ModelerView*, void*) 
+{
+	// a keyframe edit was undone or redone
+	camKeyframesChanged();
+	m_psldrTimeSlider->do_callback();
+}
+
+void ModelerUI::cb_modelerView(ModelerView* o, void* v) 
+{
+	((ModelerUI*)(o->user_data()))->cb_modelerView_i(o,v);
+}
+
 inline void ModelerUI::cb_zoomAll_i(Fl_Button*, void*) 
 {
 	m_pwndGraphWidget->zoomAll();
@@ -557,11 +609,12 @@ void ModelerUI::cb_timed(void *p)
 	if (!pui->m_bAnimating) 
 		return;
 
-	// update UI
-	float dt = 1.0 / (float)pui->m_iFps;
-	float t = pui->m_pwndGraphWidget->currTime();
+	// the time comes from the frame number, so that it does not pick up
+	// rounding errors, and the frame from the clock
+	int iFrame = pui->m_pcClock.nextFrame();
+	float t = (float)iFrame / (float)pui->m_iFps;
 
-	if ((t + dt) > pui->playEndTime()) {
+	if (t > pui->playEndTime()) {
 		// stop animating if looping not enabled or
 		// if we're saving the movie
 		if (!pui->m_pbtLoop->value() || pui->m_bSaveMovie) {
@@ -572,13 +625,16 @@ void ModelerUI::cb_timed(void *p)
 		// otherwise, reset to play start time
 		else {
 			pui->currTime(pui->playStartTime());
+			pui->m_pcClock.seek(pui->frameAt(pui->playStartTime()));
 		}
 	} 
 	else {
-		pui->currTime(t + dt);
+		pui->currTime(t);
 	}
 
-	Fl::repeat_timeout(dt, cb_timed, (void *)pui);
+	pui->updateFpsLabel();
+
+	Fl::add_timeout(pui->m_pcClock.delay(), cb_timed, (void *)pui);
 }
 
 Fl_Box* ModelerUI::labelBox(int nBox) 
@@ -623,6 +679,21 @@ void ModelerUI::activeCurvesChanged()
 	}
 }
 
+void ModelerUI::alertDamagedCurve()
+{
+	if (m_pwndGraphWidget->takeDamagedCurve())
+		fl_alert("Part of the animation script is damaged!\n%s\nThe curve was reset.",
+			m_pwndGraphWidget->loadError().c_str());
+}
+
+void ModelerUI::camKeyframesChanged()
+{
+	m_pwndIndicatorWnd->clearIndicators();
+	for (int ikf = 0; ikf < m_pwndModelerView->m_curve_camera->numKeyframes(); ++ikf)
+		m_pwndIndicatorWnd->addIndicator(m_pwndModelerView->m_curve_camera->keyframeTime(ikf));
+	m_pwndIndicatorWnd->redraw();
+}
+
 void ModelerUI::currTime(float fTime) 
 {
 	if (fTime < playStartTime())
@@ -634,6 +705,16 @@ void ModelerUI::currTime(float fTime)
 	m_pwndIndicatorWnd->floatingIndicator(fTime);
 	m_psldrTimeSlider->value(fTime);
 	m_pwndModelerView->t = fTime;
+
+	// during playback read this frame's values from the baked animation.
+	// The bake reads control values itself, so they come from the curves
+	// until it is done.
+	bool bUseBakedValues = m_bAnimating && 
+		m_ptabTab->value() == (Fl_Widget*)m_pgrpCurveGroup;
+	m_bUseBakedValues = false;
+	if (bUseBakedValues)
+		updateBakedValues();
+	m_bUseBakedValues = bUseBakedValues;
 	
 	m_pwndGraphWidget->redraw();
 	m_pwndIndicatorWnd->redraw();
@@ -764,12 +845,50 @@ float ModelerUI::controlValue(int iControl) const
 		// slider control mode
 		return valueSlider(iControl)->value();
 	}
+	else if (m_bUseBakedValues) {
+		// curve mode, playing back
+		return m_fvBakedValues[iControl];
+	}
 	else {
 		// curve mode
-		return m_pwndGraphWidget->curve(iControl)->evaluateCurveAt(m_pwndGraphWidget->currTime());
+		return m_pwndGraphWidget->sampledCurve(iControl)->evaluateCurveAt(m_pwndGraphWidget->currTime());
 	}
 }
 
+void ModelerUI::controlValues(float* pfValues)
+{
+	PROFILE_SCOPE("control values");
+
+	if (m_iCurrControlCount == 0)
+		return;
+
+	if (m_ptabTab->value() != (Fl_Widget*)m_pgrpCurveGroup) {
+		// slider control mode
+		for (int iControl = 0; iControl < m_iCurrControlCount; ++iControl)
+			pfValues[iControl] = valueSlider(iControl)->value();
+	}
+	else if (m_bUseBakedValues) {
+		// curve mode, playing back
+		memcpy(pfValues, &m_fvBakedValues[0], m_iCurrControlCount * sizeof(float));
+	}
+	else {
+		// curve mode; only the curves edited since the last frame are
+		// copied again
+		m_aeEvaluator.update(controlCurves(), m_iCurrControlCount);
+		m_aeEvaluator.eval(currTime(), pfValues);
+	}
+}
+
+const Curve* const* ModelerUI::controlCurves()
+{
+	// the constant curves of an .anib script stay unread
+	m_pcrvvControlCurves.resize(m_iCurrControlCount);
+	for (int iControl = 0; iControl < m_iCurrControlCount; ++iControl)
+		m_pcrvvControlCurves[iControl] = m_pwndGraphWidget->sampledCurve(iControl);
+
+	return m_pcrvvControlCurves.empty() ? NULL : &m_pcrvvControlCurves[0];
+}
+
 void ModelerUI::controlValue(int iControl, float fVal) 
 {
 	valueSlider(iControl)->value(fVal);
@@ -804,15 +923,57 @@ void ModelerUI::redrawModelerView()
 	m_pwndModelerView->redraw();
 	// save the frame
 	if (m_bSaveMovie) {
-		char szFrameNum[128];
-		_snprintf(szFrameNum, 128, "%d", m_iMovieFrameNum++);
-		std::string strFileName = m_strMovieFileName;
-		strFileName += szFrameNum;
-		strFileName += ".bmp";
-		m_pwndModelerView->saveBMP(strFileName.c_str());
+		// the file is written in the background
+		m_pwndModelerView->saveMovieFrame(m_meMovieExporter, m_iMovieFrameNum++);
 	}
 }
 
+void ModelerUI::updateBakedValues()
+{
+	if (m_iCurrControlCount == 0)
+		return;
+
+	const Curve* const* ppCurves = controlCurves();
+
+	// rebake only when the curves, the length or the frame rate changed
+	if (!m_abBake.upToDate(ppCurves, m_iCurrControlCount, endTime(), m_iFps))
+		m_abBake.bake(ppCurves, m_iCurrControlCount, endTime(), m_iFps);
+
+	m_fvBakedValues.resize(m_iCurrControlCount);
+	m_abBake.values(currTime(), &m_fvBakedValues[0]);
+}
+
+void ModelerUI::updateFpsLabel()
+{
+	// the title only changes about once a second
+	if (m_pcClock.achievedFps() == m_dShownFps)
+		return;
+	m_dShownFps = m_pcClock.achievedFps();
+
+	char szFps[64];
+	_snprintf(szFps, 64, " - %.1f of %d fps", m_dShownFps, m_pcClock.fps());
+	szFps[63] = 0;
+
+	m_strMainWndLabel = m_szMainWndTitle;
+	m_strMainWndLabel += szFps;
+	m_pwndMainWnd->label(m_strMainWndLabel.c_str());
+}
+
+int ModelerUI::frameAt(float fTime) const
+{
+	return (int)floor(fTime * m_iFps + 0.5f);
+}
+
+float ModelerUI::batchFrameTime(int iFrame, int iFps) const
+{
+	float fTime = (float)iFrame / (float)iFps;
+	if (fTime < playStartTime())
+		fTime = playStartTime();
+	if (fTime > playEndTime())
+		fTime = playEndTime();
+	return fTime;
+}
+
 void ModelerUI::indicatorRangeMarkerRange(float fMin, float fMax)
 {
 	m_pwndIndicatorWnd->rangeMarkerRange(fMin, fMax);
@@ -833,8 +994,12 @@ void ModelerUI::animate(bool bAnimate)
 		m_psldrPlayEnd->deactivate();
 		m_pwndIndicatorWnd->deactivate();
 
-		// if animation is enabled, add timed callback
-		Fl::add_timeout(1.0 / (float)m_iFps, cb_timed, (void *)this);
+		// if animation is enabled, add timed callback. A movie needs
+		// every frame, while playing back on screen keeps to real time.
+		m_pcClock.start(frameAt(currTime()), m_iFps, 
+			m_bSaveMovie ? PlaybackClock::kHoldFrames : PlaybackClock::kDropFrames);
+		m_dShownFps = 0.0;
+		Fl::add_timeout(m_pcClock.delay(), cb_timed, (void *)this);
 	}
 	else {
 		m_pbtPlay->label("@>");
@@ -850,8 +1015,21 @@ void ModelerUI::animate(bool bAnimate)
 
 		// otherwise, remove the callback
 		Fl::remove_timeout(cb_timed);
-
+		m_pwndMainWnd->label(m_szMainWndTitle);
+#ifdef ANIMATOR_PROFILE
+		if (m_bAnimating && m_pcClock.droppedFrames() > 0)
+			fprintf(stderr, "playback reached %.1f of %d fps, %d frames dropped\n", 
+				m_pcClock.achievedFps(), m_pcClock.fps(), m_pcClock.droppedFrames());
+#endif // ANIMATOR_PROFILE
+
+		if (m_bSaveMovie) {
+			// flush the frames still being read back or written
+			m_pwndModelerView->make_current();
+			m_meMovieExporter.end();
+		}
 		m_bSaveMovie = false;
+		// edits made while paused must show up right away
+		m_bUseBakedValues = false;
 	}
 
 	m_bAnimating = bAnimate;
@@ -865,6 +1043,9 @@ int ModelerUI::fps()
 void ModelerUI::fps(const int iFps)
 {
 	m_iFps = iFps;
+	// the frames due from now on are at the new rate
+	if (m_bAnimating && iFps != m_pcClock.fps())
+		m_pcClock.start(frameAt(currTime()), m_iFps, m_pcClock.policy());
 }
 
 ModelerUI::ModelerUI() : 
@@ -872,8 +1053,12 @@ m_iCurrControlCount(0),
 m_pcbfValueChangedCallback(NULL),
 m_iFps(30),
 m_bAnimating(false),
-m_bSaveMovie(false)
+m_bSaveMovie(false),
+m_bUseBakedValues(false),
+m_dShownFps(0.0)
 {
+	m_szMainWndTitle = m_pwndMainWnd->label();
+
 	// setup all the callback functions...
 	m_pmiOpenAniScript->callback((Fl_Callback*)cb_openAniScript);
 	m_pmiSaveAniScript->callback((Fl_Callback*)cb_saveAniScript);
@@ -888,6 +1073,7 @@ m_bSaveMovie(false)
 	m_pmiLowQuality->callback((Fl_Callback*)cb_low);
 	m_pmiPoorQuality->callback((Fl_Callback*)cb_poor);
 	m_pmiSetAniLen->callback((Fl_Callback*)cb_aniLen);
+	m_pmiReduceKeys->callback((Fl_Callback*)cb_reduceKeys);
 	m_pbrsBrowser->callback((Fl_Callback*)cb_browser);
 	m_ptabTab->callback((Fl_Callback*)cb_tab);
 	m_pwndGraphWidget->callback((Fl_Callback*)cb_graphWidget);
@@ -977,6 +1163,7 @@ void ModelerUI::replaceModelerView(ModelerView* pwndNewModelerView)
 	m_pwndModelerView = pwndNewModelerView;
 	m_pwndModelerView->resize(0, 0, m_pwndModelerWnd->w(), m_pwndModelerWnd->h());
 	m_pwndModelerWnd->add_resizable(*m_pwndModelerView);
+	m_pwndModelerView->callback((Fl_Callback*)cb_modelerView, this);
 }
 
 bool ModelerUI::openAniScript(const char* szFileName)
@@ -989,9 +1176,7 @@ bool ModelerUI::openAniScript(const char* szFileName)
 		strCamKeyframeFileName += ".cam";
 		m_pwndModelerView->m_curve_camera->loadKeyframes(strCamKeyframeFileName.c_str());
 		// sychronize the indicator window with the loaded keyframes
-		m_pwndIndicatorWnd->clearIndicators();
-		for (int ikf = 0; ikf < m_pwndModelerView->m_curve_camera->numKeyframes(); ++ikf)
-			m_pwndIndicatorWnd->addIndicator(m_pwndModelerView->m_curve_camera->keyframeTime(ikf));
+		camKeyframesChanged();
 
 		return true;
 	}
@@ -1006,3 +1191,135 @@ void ModelerUI::autoLoadNPlay()
 		animate(true);
 	}
 }
+
+int ModelerUI::renderBatch(const BatchOptions& options)
+{
+	if (!openAniScript(options.strScriptFileName.c_str())) {
+		fprintf(stderr, "ERROR: cannot open %s: %s\n", options.strScriptFileName.c_str(),
+			m_pwndGraphWidget->loadError().c_str());
+		return -1;
+	}
+
+	// a damaged curve of an .anib script only shows once it is read
+	for (int iControl = 0; iControl < m_iCurrControlCount; ++iControl)
+		m_pwndGraphWidget->curve(iControl);
+	if (m_pwndGraphWidget->takeDamagedCurve()) {
+		fprintf(stderr, "ERROR: cannot open %s: %s\n", options.strScriptFileName.c_str(),
+			m_pwndGraphWidget->loadError().c_str());
+		return -1;
+	}
+
+	// the script only drives the model in curve mode
+	m_ptabTab->value(m_pgrpCurveGroup);
+	m_pwndModelerView->camera(CURVE_MODE);
+
+	float fStartTime = options.fStartTime < 0.0f ? 0.0f : options.fStartTime;
+	float fEndTime = options.fEndTime < 0.0f ? endTime() : options.fEndTime;
+	if (fEndTime > endTime())
+		fEndTime = endTime();
+
+	// frames are numbered from time zero, so a range rendered on its
+	// own names its files the same as in a full render
+	int iFirstFrame = (int)(fStartTime * options.iFps + 0.5f);
+	int iLastFrame = (int)(fEndTime * options.iFps + 0.5f);
+	if (options.iFirstFrame >= 0) {
+		iFirstFrame = options.iFirstFrame;
+		iLastFrame = options.iLastFrame;
+	}
+
+	ParticleSystem *ps = ModelerApplication::Instance()->GetParticleSystem();
+
+	if (options.iJobs > 1) {
+		// the particles are the only state carried from frame to frame,
+		// so simulate them once here and let every job draw the bake.
+		// They are stepped at the times of the frames, as a render in
+		// one process steps them, so that splitting does not change them.
+		BatchOptions boJobOptions = options;
+		if (ps != NULL) {
+			ps->clearBaked();
+			ps->resetSimulation(0.0f);
+			ps->startSimulation(batchFrameTime(iFirstFrame, options.iFps));
+			for (int iFrame = iFirstFrame; iFrame <= iLastFrame; ++iFrame)
+				ps->computeForcesAndUpdateParticles(batchFrameTime(iFrame, options.iFps));
+			ps->stopSimulation(batchFrameTime(iLastFrame, options.iFps));
+
+			boJobOptions.strParticleFileName = options.strOutputBaseName + ".particles";
+			if (!ps->saveBaked(boJobOptions.strParticleFileName.c_str())) {
+				fprintf(stderr, "ERROR: cannot write %s\n", boJobOptions.strParticleFileName.c_str());
+				return -1;
+			}
+		}
+		int iResult = runBatchJobs(boJobOptions, iFirstFrame, iLastFrame);
+		if (!boJobOptions.strParticleFileName.empty())
+			remove(boJobOptions.strParticleFileName.c_str());
+		return iResult;
+	}
+
+	if (ps != NULL && !options.strParticleFileName.empty() &&
+		!ps->loadBaked(options.strParticleFileName.c_str())) {
+		fprintf(stderr, "ERROR: cannot read %s\n", options.strParticleFileName.c_str());
+		return -1;
+	}
+
+	// render offscreen when possible, otherwise into the modeler window,
+	// which then has to be on screen
+	OffscreenContext ocContext;
+	bool bOffscreen = ocContext.create(options.iWidth, options.iHeight);
+	if (bOffscreen) {
+		m_pwndModelerView->size(options.iWidth, options.iHeight);
+	}
+	else {
+		fprintf(stderr, "no offscreen GL context, rendering into the window\n");
+		Fl::visual(FL_RGB | FL_DOUBLE);
+		m_pwndModelerWnd->size(options.iWidth, options.iHeight);
+		m_pwndModelerWnd->show();
+		Fl::check();
+	}
+
+	// step through the frames ourselves instead of from the animation
+	// timer, so every frame is rendered exactly once and nothing waits
+	fps(options.iFps);
+	if (!m_meMovieExporter.begin(options.strOutputBaseName.c_str(), options.strFormat.c_str(), m_iFps)) {
+		fprintf(stderr, "ERROR: cannot write the frames to %s\n", options.strOutputBaseName.c_str());
+		return -1;
+	}
+	m_bAnimating = true;
+	simulate(true);
+
+	for (int iFrame = iFirstFrame; iFrame <= iLastFrame; ++iFrame) {
+		currTime(batchFrameTime(iFrame, m_iFps));
+
+		if (bOffscreen)
+			ocContext.makeCurrent();
+		else {
+			m_pwndModelerView->make_current();
+			glReadBuffer(GL_BACK);
+		}
+		m_pwndModelerView->draw();
+		m_meMovieExporter.captureFrame(iFrame, m_pwndModelerView->w(), m_pwndModelerView->h());
+	}
+
+	m_meMovieExporter.end();
+	m_bAnimating = false;
+	m_bUseBakedValues = false;
+
+#ifdef ANIMATOR_PROFILE
+	// the jobs of a split render each profile their own frames
+	std::string strProfileName = options.strOutputBaseName;
+	if (options.iFirstFrame >= 0) {
+		char szRange[64];
+		_snprintf(szRange, 64, ".%d-%d", iFirstFrame, iLastFrame);
+		szRange[63] = 0;
+		strProfileName += szRange;
+	}
+	strProfileName += ".profile";
+	if (!Profiler::instance().writeCsv((strProfileName + ".csv").c_str()) ||
+		!Profiler::instance().writeTrace((strProfileName + ".json").c_str()))
+		fprintf(stderr, "ERROR: cannot write %s\n", strProfileName.c_str());
+#endif // ANIMATOR_PROFILE
+
+	// stdout may be carrying the frames
+	fprintf(stderr, "%d frames written to %s\n", iLastFrame - iFirstFrame + 1,
+		options.strOutputBaseName.c_str());
+	return 0;
+}
@@ -12,6 +12,11 @@
 #include "modelerdraw.h"
 #include "modelerapp.h"
 #include "particleSystem.h"
+#include "animationbake.h"
+#include "animationevaluator.h"
+#include "movieexporter.h"
+#include "playbackclock.h"
+#include "batchrender.h"
 #include "modeleruiwindows.h"
 
 class ModelerUI : public ModelerUIWindows
@@ -33,6 +38,8 @@ public:
 	float playEndTime() const;
 	void controlValue(int iControl, float fVal);
 	float controlValue(int iControl) const;
+	// all the control values at once, into pfValues
+	void controlValues(float* pfValues);
 	void setValueChangedCallback(ValueChangedCallback* pcbf);
 	void animate(bool bAnimate);
 	int fps();
@@ -41,6 +48,9 @@ public:
 	void simulate(bool bSimulate);
 	void redrawModelerView();
     void autoLoadNPlay();
+	// renders the frames of a script without user interaction; returns
+	// the exit code of the program
+	int renderBatch(const BatchOptions& options);
 
 protected:
 
@@ -49,8 +59,22 @@ protected:
 	Fl_Value_Slider* valueSlider(int iSlider);
 	void redrawRulers();
 	void activeCurvesChanged();
+	// puts a mark in the indicator window at each camera keyframe
+	void camKeyframesChanged();
+	// tells the user about a curve of the script that could not be read
+	void alertDamagedCurve();
 	void indicatorRangeMarkerRange(float fMin, float fMax);
 	bool openAniScript(const char* szFileName);
+	void updateBakedValues();
+	// shows the achieved frame rate of the playback in the title
+	void updateFpsLabel();
+	// the frame nearest a time
+	int frameAt(float fTime) const;
+	// the time a batch render draws a frame at, kept to the play range
+	// as currTime keeps it
+	float batchFrameTime(int iFrame, int iFps) const;
+	// the curve of each control, for the bake and the evaluator
+	const Curve* const* controlCurves();
 	
 private:
 
@@ -63,6 +87,23 @@ private:
 	float m_fPlayStartTime, m_fPlayEndTime;
 	std::string m_strMovieFileName;
 	int m_iMovieFrameNum;
+	MovieExporter m_meMovieExporter;
+
+	// when each frame of the playback is shown, and the main window
+	// title with the frame rate it reaches
+	PlaybackClock m_pcClock;
+	const char* m_szMainWndTitle;
+	std::string m_strMainWndLabel;
+	double m_dShownFps;
+
+	// while playing back in curve mode, the control values come from
+	// the baked animation instead of evaluating the curves every frame
+	AnimationBake m_abBake;
+	bool m_bUseBakedValues;
+	std::vector<const Curve*> m_pcrvvControlCurves;
+	std::vector<float> m_fvBakedValues;
+	// otherwise the values are evaluated from copies of the curves
+	AnimationEvaluator m_aeEvaluator;
 
 	inline void cb_openAniScript_i(Fl_Menu_*, void*);
 	static void cb_openAniScript(Fl_Menu_*, void*);
@@ -92,6 +133,8 @@ private:
 	static void cb_poor(Fl_Menu_*, void*);
 	inline void cb_aniLen_i(Fl_Menu_*, void*);
 	static void cb_aniLen(Fl_Menu_*, void*);
+	inline void cb_reduceKeys_i(Fl_Menu_*, void*);
+	static void cb_reduceKeys(Fl_Menu_*, void*);
 	inline void cb_fps_i(Fl_Slider*, void*);
 	static void cb_fps(Fl_Slider*, void*);
 	inline void cb_m_modelerWindow_i(Fl_Window*, void*);
@@ -103,6 +146,8 @@ private:
 	static void cb_tab(Fl_Tabs*, void*);
 	inline void cb_graphWidget_i(GraphWidget*, void*);
 	static void cb_graphWidget(GraphWidget*, void*);
+	inline void cb_modelerView_i(ModelerView*, void*);
+	static void cb_modelerView(ModelerView*, void*);
 	inline void cb_zoomAll_i(Fl_Button*, void*);
 	static void cb_zoomAll(Fl_Button*, void*);
 	inline void cb_curveType_i(Fl_Choice*, void*);
@@ -3,6 +3,8 @@
 #include "bitmap.h"
 #include "modelerapp.h"
 #include "particleSystem.h"
+#include "movieexporter.h"
+#include "profiler.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_Gl_Window.h>
@@ -17,7 +19,7 @@ static const int	kMouseZoomButton				= FL_RIGHT_MOUSE;
 static const char *bmp_name = NULL;
 
 ModelerView::ModelerView(int x, int y, int w, int h, char *label)
-: Fl_Gl_Window(x,y,w,h,label), t(0), save_bmp(false) 
+: Fl_Gl_Window(x,y,w,h,label), t(0), save_bmp(false), m_bShowProfile(false) 
 {
 	m_ctrl_camera = new Camera();
 	m_curve_camera = new Camera();
@@ -38,8 +40,41 @@ int ModelerView::handle(int event)
 
 	switch(event)	 
 	{
+	case FL_FOCUS:
+	case FL_UNFOCUS:
+		// takes the keyboard, for undoing keyframe edits
+		return 1;
+	case FL_KEYBOARD:
+		if (Fl::event_state(FL_CTRL) && 
+			(Fl::event_key() == 'z' || Fl::event_key() == 'y')) {
+			bool bDone;
+			if (Fl::event_key() == 'y' || Fl::event_state(FL_SHIFT))
+				bDone = m_curve_camera->redoKeyframeEdit();
+			else
+				bDone = m_curve_camera->undoKeyframeEdit();
+
+			// the owner puts the keyframe marks right
+			if (bDone)
+				do_callback();
+			break;
+		}
+#ifdef ANIMATOR_PROFILE
+		if (Fl::event_state(FL_CTRL) && Fl::event_key() == 'p') {
+			if (Fl::event_state(FL_SHIFT)) {
+				// dump the frames kept, into the working directory
+				if (!Profiler::instance().writeCsv("animator_profile.csv") ||
+					!Profiler::instance().writeTrace("animator_profile.json"))
+					fprintf(stderr, "ERROR: cannot write the profile\n");
+			}
+			else
+				m_bShowProfile = !m_bShowProfile;
+			break;
+		}
+#endif // ANIMATOR_PROFILE
+		return Fl_Gl_Window::handle(event);
 	case FL_PUSH:
 		{
+			take_focus();
 			switch(eventButton)
 			{
 			case kMouseRotationButton:
@@ -93,6 +128,15 @@ static GLfloat lightDiffuse1[]  = { 1, 1, 1, 1 };
 
 void ModelerView::draw()
 {
+#ifdef ANIMATOR_PROFILE
+	// a frame of the profile runs from the start of one draw to the next
+	Profiler::instance().drawThread(std::this_thread::get_id());
+	Profiler::instance().endFrame();
+#endif // ANIMATOR_PROFILE
+
+	// the model's VAL reads come from this snapshot until endDraw
+	ModelerApplication::Instance()->BeginDraw();
+
     if (!valid())
     {
         glShadeModel( GL_SMOOTH );
@@ -144,6 +188,14 @@ void ModelerView::camera(cam_mode_t mode)
 /** Cleanup fxn for saving bitmaps **/
 void ModelerView::endDraw()
 {
+	ModelerApplication::Instance()->EndDraw();
+
+#ifdef ANIMATOR_PROFILE
+	// drawn into the frame, so saved frames show it too
+	if (m_bShowProfile)
+		Profiler::instance().drawOverlay(w(), h());
+#endif // ANIMATOR_PROFILE
+
 	if ((bmp_name == NULL) || (!save_bmp)) return;
 	glFinish();
 	saveBMP(bmp_name);
@@ -165,6 +217,8 @@ void ModelerView::saveBMP(const char* szFileName)
 	int hh = h();
 	
 	make_current();
+
+	PROFILE_SCOPE("frame readback");
 	
 	unsigned char *imageBuffer = new unsigned char[3 * ww * hh];
 	
@@ -182,3 +236,11 @@ void ModelerView::saveBMP(const char* szFileName)
 	delete [] imageBuffer;
 }
 
+void ModelerView::saveMovieFrame(MovieExporter& exporter, int iFrameNum)
+{
+	make_current();
+
+	glReadBuffer(GL_BACK);
+
+	exporter.captureFrame(iFrameNum, w(), h());
+}
@@ -13,6 +13,7 @@
 
 class Camera;
 class ModelerView;
+class MovieExporter;
 typedef ModelerView* (*ModelerViewCreator_f)(int x, int y, int w, int h, char *label);
 
 typedef enum { CTRL_MODE, CURVE_MODE } cam_mode_t;
@@ -28,6 +29,8 @@ public:
 
 	void setBMP(const char *fname);
 	void saveBMP(const char* szFileName);
+	// hands the current frame to a movie export
+	void saveMovieFrame(MovieExporter& exporter, int iFrameNum);
 	void endDraw();
 
 	void camera(cam_mode_t mode);
@@ -38,6 +41,9 @@ public:
 	float t;
 	void update();
 	bool save_bmp;
+	// draw the frame profile over the model, in a build with
+	// ANIMATOR_PROFILE; Ctrl+P toggles it
+	bool m_bShowProfile;
 };
 
 
@@ -0,0 +1,271 @@
+#include "movieexporter.h"
+#include "framewriter.h"
+#include "profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef WIN32
+#include <windows.h>
+#endif // WIN32
+#include <GL/gl.h>
+
+// pixel buffer objects are not in the OpenGL 1.1 headers
+#ifndef GL_PIXEL_PACK_BUFFER_ARB
+#define GL_PIXEL_PACK_BUFFER_ARB 0x88EB
+#endif
+#ifndef GL_STREAM_READ_ARB
+#define GL_STREAM_READ_ARB 0x88E1
+#endif
+#ifndef GL_READ_ONLY_ARB
+#define GL_READ_ONLY_ARB 0x88B8
+#endif
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+typedef void (APIENTRY * GenBuffersProc)(GLsizei n, GLuint* buffers);
+typedef void (APIENTRY * DeleteBuffersProc)(GLsizei n, const GLuint* buffers);
+typedef void (APIENTRY * BindBufferProc)(GLenum target, GLuint buffer);
+typedef void (APIENTRY * BufferDataProc)(GLenum target, ptrdiff_t size, const GLvoid* data, GLenum usage);
+typedef GLvoid* (APIENTRY * MapBufferProc)(GLenum target, GLenum access);
+typedef GLboolean (APIENTRY * UnmapBufferProc)(GLenum target);
+
+static GenBuffersProc s_pfnGenBuffers = NULL;
+static DeleteBuffersProc s_pfnDeleteBuffers = NULL;
+static BindBufferProc s_pfnBindBuffer = NULL;
+static BufferDataProc s_pfnBufferData = NULL;
+static MapBufferProc s_pfnMapBuffer = NULL;
+static UnmapBufferProc s_pfnUnmapBuffer = NULL;
+
+MovieExporter::MovieExporter() :
+	m_pfwWriter(NULL),
+	m_bExporting(false),
+	m_bStopWriter(false),
+	m_bPackBuffersChecked(false),
+	m_bUsePackBuffers(false),
+	m_iNextPackBuffer(0)
+{
+	for (int i = 0; i < k_iPackBufferCount; ++i) {
+		m_uivPackBuffers[i] = 0;
+		m_ivPackBufferSizes[i] = 0;
+		m_ivPendingFrameNums[i] = -1;
+	}
+}
+
+MovieExporter::~MovieExporter()
+{
+	// the GL context may be gone by now, so frames still sitting in the
+	// pack buffers are lost; the queued ones are still written
+	stopWriter();
+}
+
+bool MovieExporter::begin(const char* szBaseName, const char* szFormat, int iFps)
+{
+	// frames of the running export may still be in the pack buffers,
+	// which only end() can read back, with the GL context current
+	if (m_bExporting)
+		return false;
+
+	m_pfwWriter = FrameWriter::create(szFormat);
+	if (!m_pfwWriter || !m_pfwWriter->begin(szBaseName, iFps)) {
+		delete m_pfwWriter;
+		m_pfwWriter = NULL;
+		return false;
+	}
+
+	m_pfrmvFreeFrames.clear();
+	m_pfrmdQueue.clear();
+	for (int i = 0; i < k_iFramePoolSize; ++i)
+		m_pfrmvFreeFrames.push_back(&m_frmvPool[i]);
+
+	for (int i = 0; i < k_iPackBufferCount; ++i)
+		m_ivPendingFrameNums[i] = -1;
+	m_iNextPackBuffer = 0;
+
+	m_bStopWriter = false;
+	m_thdWriter = std::thread(&MovieExporter::writerLoop, this);
+	m_bExporting = true;
+	return true;
+}
+
+void MovieExporter::captureFrame(int iFrameNum, int iWidth, int iHeight)
+{
+	if (!m_bExporting || iWidth <= 0 || iHeight <= 0)
+		return;
+
+	PROFILE_SCOPE("frame readback");
+
+	if (!m_bPackBuffersChecked) {
+		m_bUsePackBuffers = initPackBuffers();
+		m_bPackBuffersChecked = true;
+	}
+
+	// the pack state is the caller's, so it is put back afterwards
+	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glPixelStorei(GL_PACK_ROW_LENGTH, iWidth);
+
+	if (!m_bUsePackBuffers) {
+		Frame* pfrmFrame = acquireFrame(iFrameNum, iWidth, iHeight);
+		glReadPixels(0, 0, iWidth, iHeight, GL_RGB, GL_UNSIGNED_BYTE, &pfrmFrame->bytes[0]);
+		glPopClientAttrib();
+		queueFrame(pfrmFrame);
+		return;
+	}
+
+	// the oldest readback in the ring has had a couple of frames to
+	// finish, so mapping it now should not stall
+	int iPackBuffer = m_iNextPackBuffer;
+	m_iNextPackBuffer = (m_iNextPackBuffer + 1) % k_iPackBufferCount;
+	readPendingFrame(iPackBuffer);
+
+	int iSize = 3 * iWidth * iHeight;
+	s_pfnBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, m_uivPackBuffers[iPackBuffer]);
+	if (m_ivPackBufferSizes[iPackBuffer] != iSize) {
+		s_pfnBufferData(GL_PIXEL_PACK_BUFFER_ARB, iSize, NULL, GL_STREAM_READ_ARB);
+		m_ivPackBufferSizes[iPackBuffer] = iSize;
+	}
+	// with a pack buffer bound this only starts the transfer
+	glReadPixels(0, 0, iWidth, iHeight, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	s_pfnBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	glPopClientAttrib();
+
+	m_ivPendingFrameNums[iPackBuffer] = iFrameNum;
+	m_ivPendingWidths[iPackBuffer] = iWidth;
+	m_ivPendingHeights[iPackBuffer] = iHeight;
+}
+
+void MovieExporter::end()
+{
+	if (!m_bExporting)
+		return;
+
+	if (m_bUsePackBuffers) {
+		// collect the readbacks still in flight, oldest first
+		for (int i = 0; i < k_iPackBufferCount; ++i)
+			readPendingFrame((m_iNextPackBuffer + i) % k_iPackBufferCount);
+
+		s_pfnDeleteBuffers(k_iPackBufferCount, m_uivPackBuffers);
+		for (int i = 0; i < k_iPackBufferCount; ++i) {
+			m_uivPackBuffers[i] = 0;
+			m_ivPackBufferSizes[i] = 0;
+		}
+		// the next movie may render into another context
+		m_bPackBuffersChecked = false;
+	}
+
+	stopWriter();
+}
+
+bool MovieExporter::initPackBuffers()
+{
+	const char* szExtensions = (const char*)glGetString(GL_EXTENSIONS);
+	if (!szExtensions || !strstr(szExtensions, "GL_ARB_pixel_buffer_object"))
+		return false;
+
+#ifdef WIN32
+	s_pfnGenBuffers = (GenBuffersProc)wglGetProcAddress("glGenBuffersARB");
+	s_pfnDeleteBuffers = (DeleteBuffersProc)wglGetProcAddress("glDeleteBuffersARB");
+	s_pfnBindBuffer = (BindBufferProc)wglGetProcAddress("glBindBufferARB");
+	s_pfnBufferData = (BufferDataProc)wglGetProcAddress("glBufferDataARB");
+	s_pfnMapBuffer = (MapBufferProc)wglGetProcAddress("glMapBufferARB");
+	s_pfnUnmapBuffer = (UnmapBufferProc)wglGetProcAddress("glUnmapBufferARB");
+#endif // WIN32
+
+	if (!s_pfnGenBuffers || !s_pfnDeleteBuffers || !s_pfnBindBuffer ||
+		!s_pfnBufferData || !s_pfnMapBuffer || !s_pfnUnmapBuffer)
+		return false;
+
+	s_pfnGenBuffers(k_iPackBufferCount, m_uivPackBuffers);
+	return true;
+}
+
+void MovieExporter::readPendingFrame(int iPackBuffer)
+{
+	if (m_ivPendingFrameNums[iPackBuffer] < 0)
+		return;
+
+	Frame* pfrmFrame = acquireFrame(m_ivPendingFrameNums[iPackBuffer],
+		m_ivPendingWidths[iPackBuffer], m_ivPendingHeights[iPackBuffer]);
+
+	s_pfnBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, m_uivPackBuffers[iPackBuffer]);
+	const void* pvPixels = s_pfnMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+	if (pvPixels) {
+		memcpy(&pfrmFrame->bytes[0], pvPixels, pfrmFrame->bytes.size());
+		s_pfnUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+	}
+	s_pfnBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+	m_ivPendingFrameNums[iPackBuffer] = -1;
+	queueFrame(pfrmFrame);
+}
+
+MovieExporter::Frame* MovieExporter::acquireFrame(int iFrameNum, int iWidth, int iHeight)
+{
+	std::unique_lock<std::mutex> lock(m_mtxQueue);
+	while (m_pfrmvFreeFrames.empty())
+		m_cvFrameFree.wait(lock);
+
+	Frame* pfrmFrame = m_pfrmvFreeFrames.back();
+	m_pfrmvFreeFrames.pop_back();
+	lock.unlock();
+
+	// the pool keeps its buffers, so this only allocates for the first
+	// frames or when the window is resized
+	pfrmFrame->bytes.resize(3 * iWidth * iHeight);
+	pfrmFrame->iWidth = iWidth;
+	pfrmFrame->iHeight = iHeight;
+	pfrmFrame->iFrameNum = iFrameNum;
+	return pfrmFrame;
+}
+
+void MovieExporter::queueFrame(Frame* pfrmFrame)
+{
+	std::lock_guard<std::mutex> lock(m_mtxQueue);
+	m_pfrmdQueue.push_back(pfrmFrame);
+	m_cvFrameQueued.notify_one();
+}
+
+void MovieExporter::stopWriter()
+{
+	if (!m_bExporting)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mtxQueue);
+		m_bStopWriter = true;
+		m_cvFrameQueued.notify_one();
+	}
+	m_thdWriter.join();
+	m_bExporting = false;
+
+	m_pfwWriter->end();
+	delete m_pfwWriter;
+	m_pfwWriter = NULL;
+}
+
+void MovieExporter::writerLoop()
+{
+	for (;;) {
+		Frame* pfrmFrame;
+		{
+			std::unique_lock<std::mutex> lock(m_mtxQueue);
+			while (m_pfrmdQueue.empty() && !m_bStopWriter)
+				m_cvFrameQueued.wait(lock);
+			// drain the queue before stopping
+			if (m_pfrmdQueue.empty())
+				return;
+			pfrmFrame = m_pfrmdQueue.front();
+			m_pfrmdQueue.pop_front();
+		}
+
+		if (!m_pfwWriter->writeFrame(pfrmFrame->iFrameNum, pfrmFrame->iWidth,
+				pfrmFrame->iHeight, &pfrmFrame->bytes[0]))
+			fprintf(stderr, "ERROR: cannot write frame %d\n", pfrmFrame->iFrameNum);
+
+		std::lock_guard<std::mutex> lock(m_mtxQueue);
+		m_pfrmvFreeFrames.push_back(pfrmFrame);
+		m_cvFrameFree.notify_one();
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef MOVIEEXPORTER_H_INCLUDED
+#define MOVIEEXPORTER_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class FrameWriter;
+
+// Saves the frames of a movie through a FrameWriter without stalling the
+// UI. Frames are read back through a ring of pixel pack buffers, so the
+// transfer of one frame overlaps the rendering of the next ones, and the
+// files are written by a background thread. When pixel buffer objects are
+// not supported, frames are read back synchronously but still written in
+// the background.
+class MovieExporter
+{
+public:
+	MovieExporter();
+	~MovieExporter();
+
+	// frame i is saved to szBaseName followed by i and the extension of
+	// szFormat, one of the formats of FrameWriter::create. Returns false
+	// for an unknown format, or while the last export has not ended.
+	bool begin(const char* szBaseName, const char* szFormat, int iFps);
+	// reads back the back buffer of the current GL context; the frame is
+	// written out later
+	void captureFrame(int iFrameNum, int iWidth, int iHeight);
+	// waits for every captured frame to be written. The GL context used
+	// for capturing must be current.
+	void end();
+	bool exporting() const { return m_bExporting; }
+
+protected:
+	struct Frame
+	{
+		std::vector<unsigned char> bytes;
+		int iWidth;
+		int iHeight;
+		int iFrameNum;
+	};
+
+	// frames in flight between the GL readback and the writer thread; the
+	// capture blocks when all of them are waiting to be written
+	static const int k_iFramePoolSize = 4;
+	// frames a readback is given to finish before it is mapped
+	static const int k_iPackBufferCount = 3;
+
+	FrameWriter* m_pfwWriter;
+	bool m_bExporting;
+
+	Frame m_frmvPool[k_iFramePoolSize];
+	std::vector<Frame*> m_pfrmvFreeFrames;
+	std::deque<Frame*> m_pfrmdQueue;
+	std::mutex m_mtxQueue;
+	std::condition_variable m_cvFrameFree;
+	std::condition_variable m_cvFrameQueued;
+	std::thread m_thdWriter;
+	bool m_bStopWriter;
+
+	bool m_bPackBuffersChecked;
+	bool m_bUsePackBuffers;
+	unsigned int m_uivPackBuffers[k_iPackBufferCount];
+	int m_ivPackBufferSizes[k_iPackBufferCount];
+	// the frame waiting in each pack buffer, -1 if none
+	int m_ivPendingFrameNums[k_iPackBufferCount];
+	int m_ivPendingWidths[k_iPackBufferCount];
+	int m_ivPendingHeights[k_iPackBufferCount];
+	int m_iNextPackBuffer;
+
+	bool initPackBuffers();
+	void readPendingFrame(int iPackBuffer);
+	Frame* acquireFrame(int iFrameNum, int iWidth, int iHeight);
+	void queueFrame(Frame* pfrmFrame);
+	void stopWriter();
+	void writerLoop();
+};
+
+#endif // MOVIEEXPORTER_H_INCLUDED
@@ -1,6 +1,7 @@
 #pragma warning(disable : 4786)
 
 #include "particleSystem.h"
+#include "profiler.h"
 
 
 #include <stdio.h>
@@ -8,6 +9,7 @@
 #include <assert.h>
 #include <math.h>
 #include <limits.h>
+#include <string.h>
 
 
 /***************
@@ -113,6 +115,7 @@ void ParticleSystem::resetSimulation(float t)
 /** Compute forces and update initial_state **/
 void ParticleSystem::computeForcesAndUpdateParticles(float t)
 {
+	PROFILE_SCOPE("particle step");
 
 	// TODO
 	if (simulate){
@@ -189,6 +192,7 @@ void ParticleSystem::computeForcesAndUpdateParticles(float t)
 /** Render initial_state */
 void ParticleSystem::drawParticles(float t)
 {
+	PROFILE_SCOPE("particle draw");
 	if (simulate){
 		float roundedTime = round(t*bake_fps) / bake_fps;
 		Particle* p = particles;
@@ -246,6 +250,80 @@ void ParticleSystem::clearBaked()
 	bakedParticles.clear();
 }
 
+/** Writes the baked particles to a file */
+bool ParticleSystem::saveBaked(const char* fileName)
+{
+	FILE* file = fopen(fileName, "wb");
+	if (file == NULL)
+		return false;
+
+	// header: particle count, bake fps and number of baked frames,
+	// then the time and the position, velocity and force of every
+	// particle for each frame
+	int bakedCount = (int)bakedParticles.size();
+	fwrite(&n, sizeof(int), 1, file);
+	fwrite(&bake_fps, sizeof(float), 1, file);
+	fwrite(&bakedCount, sizeof(int), 1, file);
+
+	float* frame = new float[9 * n];
+	for (std::map<float, Particle*>::iterator it = bakedParticles.begin(); it != bakedParticles.end(); ++it){
+		Particle* p = it->second;
+		for (int i = 0; i < n; i++){
+			memcpy(&frame[9 * i], p[i].getPositionVectors(), 3 * sizeof(float));
+			memcpy(&frame[9 * i + 3], p[i].getVelocityVectors(), 3 * sizeof(float));
+			memcpy(&frame[9 * i + 6], p[i].getForceVectors(), 3 * sizeof(float));
+		}
+		fwrite(&it->first, sizeof(float), 1, file);
+		fwrite(frame, sizeof(float), 9 * n, file);
+	}
+	delete[] frame;
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+/** Replaces the baked particles with the ones saved in a file */
+bool ParticleSystem::loadBaked(const char* fileName)
+{
+	FILE* file = fopen(fileName, "rb");
+	if (file == NULL)
+		return false;
+
+	int count, bakedCount;
+	float fps;
+	if (fread(&count, sizeof(int), 1, file) != 1 || fread(&fps, sizeof(float), 1, file) != 1 ||
+		fread(&bakedCount, sizeof(int), 1, file) != 1 || count != n || bakedCount < 0 ||
+		!(fps > 0.0f)){
+		fclose(file);
+		return false;
+	}
+
+	clearBaked();
+	bake_fps = fps;
+
+	bool ok = true;
+	float* frame = new float[9 * n];
+	for (int k = 0; k < bakedCount; k++){
+		float time;
+		if (fread(&time, sizeof(float), 1, file) != 1 || fread(frame, sizeof(float), 9 * n, file) != (size_t)(9 * n)){
+			ok = false;
+			break;
+		}
+		Particle* p = new Particle[n];
+		for (int i = 0; i < n; i++){
+			p[i].setPositionVectors(&frame[9 * i]);
+			p[i].setVelocityVectors(&frame[9 * i + 3]);
+			p[i].setForceVectors(&frame[9 * i + 6]);
+		}
+		bakedParticles.insert(std::pair<float, Particle*>(time, p));
+	}
+	delete[] frame;
+
+	fclose(file);
+	return ok;
+}
+
 // functions from the given pdf (Physically Based Modeling: Principles and Practice)
 /* gather state from the initial_state into dst */
 void ParticleSystem::getState(float *dst){
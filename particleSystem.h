@@ -113,6 +113,12 @@ public:
 	// of baked particles (without leaking memory).
 	virtual void clearBaked();	
 
+	// These functions write the baked particles to a file and read them
+	// back, so that other processes draw the same simulation without
+	// running it. Loading replaces the baked particles.
+	bool saveBaked(const char* fileName);
+	bool loadBaked(const char* fileName);
+
 
 
 	// These accessor fxns are implemented for you
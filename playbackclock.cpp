@@ -0,0 +1,104 @@
+#include "playbackclock.h"
+
+#include <math.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif // WIN32
+
+#ifdef _DEBUG
+#include <assert.h>
+#endif // _DEBUG
+
+// how long the achieved rate is measured over
+static const double k_dRateInterval = 1.0;
+
+PlaybackClock::PlaybackClock() :
+	m_pPolicy(kDropFrames),
+	m_iFps(30),
+	m_iStartFrame(0),
+	m_dStartTime(0.0),
+	m_iFrame(0),
+	m_iDroppedFrames(0),
+	m_iRateFrames(0),
+	m_dRateStartTime(0.0),
+	m_dAchievedFps(0.0)
+{
+}
+
+double PlaybackClock::now()
+{
+#ifdef WIN32
+	// the steady_clock of this compiler is neither steady nor fine enough
+	static LARGE_INTEGER liFrequency = { 0 };
+	if (liFrequency.QuadPart == 0)
+		QueryPerformanceFrequency(&liFrequency);
+
+	LARGE_INTEGER liCounter;
+	QueryPerformanceCounter(&liCounter);
+	return (double)liCounter.QuadPart / (double)liFrequency.QuadPart;
+#else
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif // WIN32
+}
+
+void PlaybackClock::start(const int iFrame, const int iFps, const Policy pPolicy)
+{
+#ifdef _DEBUG
+	assert(iFps > 0);
+#endif // _DEBUG
+
+	m_iFps = iFps;
+	m_pPolicy = pPolicy;
+	m_iDroppedFrames = 0;
+	m_iRateFrames = 0;
+	m_dAchievedFps = 0.0;
+	seek(iFrame);
+	m_dRateStartTime = m_dStartTime;
+}
+
+void PlaybackClock::seek(const int iFrame)
+{
+	m_iStartFrame = m_iFrame = iFrame;
+	m_dStartTime = now();
+}
+
+int PlaybackClock::nextFrame()
+{
+	double dNow = now();
+
+	int iNext = m_iFrame + 1;
+	int iDue = m_iStartFrame + (int)floor((dNow - m_dStartTime) * m_iFps);
+	if (iDue > iNext) {
+		if (m_pPolicy == kDropFrames) {
+			m_iDroppedFrames += iDue - iNext;
+			iNext = iDue;
+		}
+		else {
+			// the late frame is shown now, and the schedule goes on from it
+			m_iStartFrame = iNext;
+			m_dStartTime = dNow;
+		}
+	}
+	// a timer that fires a little early still shows the next frame, so
+	// that no frame is shown twice
+	m_iFrame = iNext;
+
+	++m_iRateFrames;
+	if (dNow - m_dRateStartTime >= k_dRateInterval) {
+		m_dAchievedFps = m_iRateFrames / (dNow - m_dRateStartTime);
+		m_iRateFrames = 0;
+		m_dRateStartTime = dNow;
+	}
+
+	return m_iFrame;
+}
+
+double PlaybackClock::delay() const
+{
+	double dDue = m_dStartTime + (double)(m_iFrame + 1 - m_iStartFrame) / m_iFps;
+	double dDelay = dDue - now();
+	return dDelay > 0.0 ? dDelay : 0.0;
+}
@@ -0,0 +1,57 @@
+#ifndef PLAYBACKCLOCK_H_INCLUDED
+#define PLAYBACKCLOCK_H_INCLUDED
+
+// Decides which frame of the animation to show and when. The frames are
+// due at times counted from the start of playback on a monotonic clock,
+// not by adding up the waits between them, so playback does not drift
+// however long each frame takes to draw.
+class PlaybackClock
+{
+public:
+	enum Policy
+	{
+		// keep to real time, skipping the frames that are already late
+		kDropFrames,
+		// show every frame; when one is late, the ones after it are
+		// shown a frame apart from it, and playback falls behind
+		kHoldFrames
+	};
+
+	PlaybackClock();
+
+	// iFrame is on screen now and playback goes on at iFps frames per
+	// second; the achieved rate is counted again from here
+	void start(const int iFrame, const int iFps, const Policy pPolicy);
+	// iFrame is on screen now, as when playback loops
+	void seek(const int iFrame);
+	// the frame to show now, after the one shown last
+	int nextFrame();
+	// seconds until the frame after the one shown last is due
+	double delay() const;
+
+	int fps() const { return m_iFps; }
+	Policy policy() const { return m_pPolicy; }
+	// the frames shown per second, measured over about a second; 0 until
+	// playback has gone on that long
+	double achievedFps() const { return m_dAchievedFps; }
+	// the frames skipped since start
+	int droppedFrames() const { return m_iDroppedFrames; }
+
+	// seconds on the monotonic clock
+	static double now();
+
+protected:
+	Policy m_pPolicy;
+	int m_iFps;
+	// the frames are due 1/fps apart from m_iStartFrame at m_dStartTime
+	int m_iStartFrame;
+	double m_dStartTime;
+	int m_iFrame;
+	int m_iDroppedFrames;
+	// the frames shown since m_dRateStartTime
+	int m_iRateFrames;
+	double m_dRateStartTime;
+	double m_dAchievedFps;
+};
+
+#endif // PLAYBACKCLOCK_H_INCLUDED
@@ -0,0 +1,242 @@
+#include "profiler.h"
+#include "playbackclock.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef WIN32
+#include <windows.h>
+#endif // WIN32
+#include <GL/gl.h>
+#include <FL/Enumerations.H>
+#include <FL/gl.h>
+
+Profiler& Profiler::instance()
+{
+	static Profiler s_pfProfiler;
+	return s_pfProfiler;
+}
+
+Profiler::Profiler() :
+	m_tidDraw(std::thread::id()),
+	m_fvFrames(kFrameCapacity * kMaxSections),
+	m_fvFrameLengths(kFrameCapacity),
+	m_pevEvents(kEventCapacity)
+{
+	clear();
+}
+
+int Profiler::section(const char* szName)
+{
+	for (int iSection = 0; iSection < sectionCount(); ++iSection) {
+		if (!strcmp(m_szvSections[iSection], szName))
+			return iSection;
+	}
+
+	if (sectionCount() == kMaxSections)
+		return -1;
+	m_szvSections.push_back(szName);
+	return sectionCount() - 1;
+}
+
+void Profiler::record(const int iSection, const double dStart, const double dEnd)
+{
+	if (iSection < 0 || std::this_thread::get_id() != m_tidDraw)
+		return;
+
+	m_fvCurrent[iSection] += (float)((dEnd - dStart) * 1000.0);
+
+	ProfileEvent& peEvent = m_pevEvents[m_iEvents % kEventCapacity];
+	peEvent.iSection = iSection;
+	peEvent.dStart = dStart;
+	peEvent.dEnd = dEnd;
+	// the count stays where it falls in the ring once the ring is full
+	if (++m_iEvents == 2 * kEventCapacity)
+		m_iEvents = kEventCapacity;
+}
+
+void Profiler::endFrame()
+{
+	double dNow = PlaybackClock::now();
+
+	int iRow = m_iFrames % kFrameCapacity;
+	memcpy(&m_fvFrames[iRow * kMaxSections], m_fvCurrent, sizeof(m_fvCurrent));
+	m_fvFrameLengths[iRow] = m_dFrameStart < 0.0 ? 0.0f : (float)((dNow - m_dFrameStart) * 1000.0);
+	if (++m_iFrames == 2 * kFrameCapacity)
+		m_iFrames = kFrameCapacity;
+
+	memset(m_fvCurrent, 0, sizeof(m_fvCurrent));
+	m_dFrameStart = dNow;
+}
+
+void Profiler::clear()
+{
+	memset(m_fvCurrent, 0, sizeof(m_fvCurrent));
+	m_iFrames = 0;
+	m_dFrameStart = -1.0;
+	m_iEvents = 0;
+}
+
+int Profiler::frameCount() const
+{
+	return m_iFrames < kFrameCapacity ? m_iFrames : kFrameCapacity;
+}
+
+int Profiler::frameRow(const int iFrame) const
+{
+	return (m_iFrames - frameCount() + iFrame) % kFrameCapacity;
+}
+
+float Profiler::sectionTime(const int iFrame, const int iSection) const
+{
+	return m_fvFrames[frameRow(iFrame) * kMaxSections + iSection];
+}
+
+float Profiler::frameTime(const int iFrame) const
+{
+	return m_fvFrameLengths[frameRow(iFrame)];
+}
+
+void Profiler::drawOverlay(const int iWidth, const int iHeight) const
+{
+	int iFrameCount = frameCount();
+	if (iFrameCount == 0)
+		return;
+
+	// the average and the worst time of the frame, then of each section
+	int iRows = sectionCount() + 1;
+	std::vector<float> fvAverage(iRows, 0.0f);
+	std::vector<float> fvWorst(iRows, 0.0f);
+	for (int iFrame = 0; iFrame < iFrameCount; ++iFrame) {
+		for (int iRow = 0; iRow < iRows; ++iRow) {
+			float fTime = iRow == 0 ? frameTime(iFrame) : sectionTime(iFrame, iRow - 1);
+			fvAverage[iRow] += fTime;
+			if (fTime > fvWorst[iRow])
+				fvWorst[iRow] = fTime;
+		}
+	}
+	for (int iRow = 0; iRow < iRows; ++iRow)
+		fvAverage[iRow] /= iFrameCount;
+
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_TRANSFORM_BIT | 
+		GL_VIEWPORT_BIT | GL_COLOR_BUFFER_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_TEXTURE_2D);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glViewport(0, 0, iWidth, iHeight);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0.0, iWidth, 0.0, iHeight, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	const int iRowHeight = 14;
+	const int iLeft = 4;
+	const int iBarLeft = iLeft + 120;
+	const int iBarWidth = 100;
+	const int iTop = iHeight - 4;
+
+	glColor4f(0.0f, 0.0f, 0.0f, 0.6f);
+	glRecti(iLeft, iTop - iRows * iRowHeight - 4, iBarLeft + iBarWidth + 150, iTop);
+
+	// the bars are the share of the average frame
+	float fFrame = fvAverage[0] > 0.0f ? fvAverage[0] : 1.0f;
+	glColor4f(1.0f, 0.6f, 0.0f, 0.8f);
+	for (int iRow = 1; iRow < iRows; ++iRow) {
+		int y = iTop - (iRow + 1) * iRowHeight;
+		float fShare = fvAverage[iRow] / fFrame;
+		glRecti(iBarLeft, y, iBarLeft + (int)(iBarWidth * (fShare < 1.0f ? fShare : 1.0f)), 
+			y + iRowHeight - 3);
+	}
+
+	gl_font(FL_HELVETICA, 11);
+	glColor3f(1.0f, 1.0f, 1.0f);
+	char szLine[128];
+	for (int iRow = 0; iRow < iRows; ++iRow) {
+		int y = iTop - (iRow + 1) * iRowHeight + 2;
+		gl_draw(iRow == 0 ? "frame" : sectionName(iRow - 1), iLeft + 4, y);
+		if (iRow == 0)
+			_snprintf(szLine, 128, "%.2f ms, worst %.2f, %.1f fps", fvAverage[0], fvWorst[0], 
+				1000.0f / fFrame);
+		else
+			_snprintf(szLine, 128, "%.2f ms, worst %.2f", fvAverage[iRow], fvWorst[iRow]);
+		szLine[127] = 0;
+		gl_draw(szLine, iRow == 0 ? iBarLeft : iBarLeft + iBarWidth + 6, y);
+	}
+
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	glPopAttrib();
+}
+
+bool Profiler::writeCsv(const char* szFileName) const
+{
+	FILE* pFile = fopen(szFileName, "w");
+	if (pFile == NULL)
+		return false;
+
+	fprintf(pFile, "frame,frame ms");
+	for (int iSection = 0; iSection < sectionCount(); ++iSection)
+		fprintf(pFile, ",%s ms", sectionName(iSection));
+	fprintf(pFile, "\n");
+
+	for (int iFrame = 0; iFrame < frameCount(); ++iFrame) {
+		fprintf(pFile, "%d,%.4f", iFrame, frameTime(iFrame));
+		for (int iSection = 0; iSection < sectionCount(); ++iSection)
+			fprintf(pFile, ",%.4f", sectionTime(iFrame, iSection));
+		fprintf(pFile, "\n");
+	}
+
+	bool bWritten = !ferror(pFile);
+	return fclose(pFile) == 0 && bWritten;
+}
+
+bool Profiler::writeTrace(const char* szFileName) const
+{
+	FILE* pFile = fopen(szFileName, "w");
+	if (pFile == NULL)
+		return false;
+
+	// complete events, in microseconds from the start of the first scope;
+	// a scope is recorded when it ends, after the scopes inside it
+	int iEventCount = m_iEvents < kEventCapacity ? m_iEvents : kEventCapacity;
+	int iFirst = m_iEvents - iEventCount;
+	double dTraceStart = iEventCount > 0 ? m_pevEvents[iFirst % kEventCapacity].dStart : 0.0;
+	for (int i = 1; i < iEventCount; ++i) {
+		double dStart = m_pevEvents[(iFirst + i) % kEventCapacity].dStart;
+		if (dStart < dTraceStart)
+			dTraceStart = dStart;
+	}
+
+	fprintf(pFile, "{\"traceEvents\":[\n");
+	for (int i = 0; i < iEventCount; ++i) {
+		const ProfileEvent& peEvent = m_pevEvents[(iFirst + i) % kEventCapacity];
+		fprintf(pFile, "{\"name\":\"%s\",\"cat\":\"animator\",\"ph\":\"X\","
+			"\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}%s\n",
+			sectionName(peEvent.iSection), 
+			(peEvent.dStart - dTraceStart) * 1.0e6,
+			(peEvent.dEnd - peEvent.dStart) * 1.0e6,
+			i + 1 < iEventCount ? "," : "");
+	}
+	fprintf(pFile, "]}\n");
+
+	bool bWritten = !ferror(pFile);
+	return fclose(pFile) == 0 && bWritten;
+}
+
+ProfileScope::ProfileScope(const int iSection) :
+	m_iSection(iSection),
+	m_dStart(PlaybackClock::now())
+{
+}
+
+ProfileScope::~ProfileScope()
+{
+	Profiler::instance().record(m_iSection, m_dStart, PlaybackClock::now());
+}
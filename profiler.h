@@ -0,0 +1,106 @@
+#ifndef PROFILER_H_INCLUDED
+#define PROFILER_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+
+// Where the time of each frame goes. PROFILE_SCOPE(szName) times the rest
+// of the block it is in as the section szName; a frame ends at each
+// endFrame, which ModelerView::draw calls as it starts a draw. The time of each section
+// in each of the last frames is kept in a ring for the overlay and the
+// CSV dump, and every timed scope is kept in a ring of events for the
+// Chrome trace (chrome://tracing). Sections can nest, and a section's
+// time includes the sections inside it.
+//
+// The timers are only compiled in when ANIMATOR_PROFILE is defined. Only
+// the thread that draws is timed, the one ModelerView::draw names with
+// drawThread; scopes on other threads, or before the first draw, are
+// ignored.
+class Profiler
+{
+public:
+	enum { kMaxSections = 32, kFrameCapacity = 240, kEventCapacity = 1 << 16 };
+
+	static Profiler& instance();
+
+	// the number of the section named szName, which has to stay valid
+	int section(const char* szName);
+	// a scope of the section ran from dStart to dEnd, in seconds
+	void record(const int iSection, const double dStart, const double dEnd);
+	void endFrame();
+	void clear();
+	// the scopes of this thread are timed from now on
+	void drawThread(const std::thread::id& tidDraw) { m_tidDraw = tidDraw; }
+
+	int sectionCount() const { return m_szvSections.size(); }
+	const char* sectionName(const int iSection) const { return m_szvSections[iSection]; }
+	// the frames kept, the oldest first
+	int frameCount() const;
+	// milliseconds spent in a section in a frame kept, and from the end of
+	// the frame before to the end of the frame
+	float sectionTime(const int iFrame, const int iSection) const;
+	float frameTime(const int iFrame) const;
+
+	// the averages and the worst of the frames kept as a table in the top
+	// left corner of a view iWidth by iHeight, over what is drawn already
+	void drawOverlay(const int iWidth, const int iHeight) const;
+	// a row of section times for each frame kept; false if the file
+	// cannot be written
+	bool writeCsv(const char* szFileName) const;
+	// the scopes kept, in the trace event format of chrome://tracing
+	bool writeTrace(const char* szFileName) const;
+
+protected:
+	Profiler();
+
+	struct ProfileEvent
+	{
+		int iSection;
+		double dStart;
+		double dEnd;
+	};
+
+	std::atomic<std::thread::id> m_tidDraw;
+	std::vector<const char*> m_szvSections;
+	// the time of each section in the frame so far
+	float m_fvCurrent[kMaxSections];
+	// kMaxSections times per frame, for kFrameCapacity frames; the frames
+	// counted so far are m_iFrames, and frame i is in row i % kFrameCapacity
+	std::vector<float> m_fvFrames;
+	std::vector<float> m_fvFrameLengths;
+	int m_iFrames;
+	double m_dFrameStart;
+	// the last kEventCapacity of the m_iEvents scopes recorded
+	std::vector<ProfileEvent> m_pevEvents;
+	int m_iEvents;
+
+	int frameRow(const int iFrame) const;
+};
+
+// times the rest of the block as a section of the frame
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const int iSection);
+	~ProfileScope();
+
+protected:
+	int m_iSection;
+	double m_dStart;
+};
+
+#ifdef ANIMATOR_PROFILE
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(szName) \
+	static const int PROFILE_CONCAT(s_iProfileSection, __LINE__) = Profiler::instance().section(szName); \
+	ProfileScope PROFILE_CONCAT(psProfileScope, __LINE__)(PROFILE_CONCAT(s_iProfileSection, __LINE__))
+#else
+#define PROFILE_SCOPE(szName)
+#endif // ANIMATOR_PROFILE
+
+#endif // PROFILER_H_INCLUDED
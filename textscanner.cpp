@@ -0,0 +1,212 @@
+#include "textscanner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// powers of ten that are exact in a float
+static const float s_fvPowersOfTen[] = {
+	1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+TextScanner::TextScanner(const char* pcBegin, const char* pcEnd) :
+	m_pcPos(pcBegin),
+	m_pcEnd(pcEnd),
+	m_iLine(1),
+	m_bFailed(false)
+{
+}
+
+bool TextScanner::loadFile(const char* szFileName, std::vector<char>& cvBuffer)
+{
+	cvBuffer.clear();
+
+	FILE* pfFile = fopen(szFileName, "rb");
+	if (!pfFile)
+		return false;
+
+	fseek(pfFile, 0, SEEK_END);
+	long lBytes = ftell(pfFile);
+	fseek(pfFile, 0, SEEK_SET);
+
+	bool bRead = lBytes >= 0;
+	if (lBytes > 0) {
+		cvBuffer.resize(lBytes);
+		setvbuf(pfFile, NULL, _IONBF, 0);
+		bRead = fread(&cvBuffer[0], lBytes, 1, pfFile) == 1;
+	}
+	fclose(pfFile);
+	return bRead;
+}
+
+void TextScanner::fail(const char* szExpected)
+{
+	// keep the first error, the later ones follow from it
+	if (m_bFailed)
+		return;
+
+	char szError[128];
+	_snprintf(szError, 128, "line %d: expected %s", m_iLine, szExpected);
+	szError[127] = 0;
+	m_strError = szError;
+	m_bFailed = true;
+}
+
+const char* TextScanner::nextToken()
+{
+	while (m_pcPos < m_pcEnd) {
+		char c = *m_pcPos;
+		if (c == '\n')
+			++m_iLine;
+		else if (c != ' ' && c != '\t' && c != '\r' && c != '\v' && c != '\f')
+			break;
+		++m_pcPos;
+	}
+
+	const char* pcTokenEnd = m_pcPos;
+	while (pcTokenEnd < m_pcEnd) {
+		char c = *pcTokenEnd;
+		if (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f')
+			break;
+		++pcTokenEnd;
+	}
+	return pcTokenEnd;
+}
+
+bool TextScanner::readInt(int& iValue)
+{
+	if (m_bFailed)
+		return false;
+
+	const char* pcTokenEnd = nextToken();
+	const char* pc = m_pcPos;
+
+	bool bNegative = false;
+	if (pc < pcTokenEnd && (*pc == '-' || *pc == '+'))
+		bNegative = *pc++ == '-';
+
+	// at most 9 digits, so that the value cannot overflow
+	int iDigits = 0;
+	int iResult = 0;
+	while (pc < pcTokenEnd && *pc >= '0' && *pc <= '9' && iDigits < 9) {
+		iResult = iResult * 10 + (*pc++ - '0');
+		++iDigits;
+	}
+
+	if (iDigits == 0 || pc != pcTokenEnd) {
+		fail("an integer");
+		return false;
+	}
+
+	iValue = bNegative ? -iResult : iResult;
+	m_pcPos = pcTokenEnd;
+	return true;
+}
+
+bool TextScanner::readBool(bool& bValue)
+{
+	int iValue;
+	if (!readInt(iValue))
+		return false;
+
+	if (iValue != 0 && iValue != 1) {
+		fail("0 or 1");
+		return false;
+	}
+
+	bValue = iValue != 0;
+	return true;
+}
+
+bool TextScanner::readFloat(float& fValue)
+{
+	if (m_bFailed)
+		return false;
+
+	const char* pcTokenEnd = nextToken();
+	const char* pc = m_pcPos;
+
+	bool bNegative = false;
+	if (pc < pcTokenEnd && (*pc == '-' || *pc == '+'))
+		bNegative = *pc++ == '-';
+
+	// the digits as an integer times a power of ten. Anything that does
+	// not fit the fast path below goes to the C library.
+	unsigned int uiMantissa = 0;
+	int iExponent = 0;
+	int iDigits = 0;
+	bool bExact = true;
+
+	while (pc < pcTokenEnd && *pc >= '0' && *pc <= '9') {
+		if (uiMantissa < 100000000u)
+			uiMantissa = uiMantissa * 10 + (*pc - '0');
+		else
+			bExact = false;
+		++pc;
+		++iDigits;
+	}
+	if (pc < pcTokenEnd && *pc == '.') {
+		++pc;
+		while (pc < pcTokenEnd && *pc >= '0' && *pc <= '9') {
+			if (uiMantissa < 100000000u) {
+				uiMantissa = uiMantissa * 10 + (*pc - '0');
+				--iExponent;
+			}
+			else
+				bExact = false;
+			++pc;
+			++iDigits;
+		}
+	}
+	if (iDigits > 0 && pc < pcTokenEnd && (*pc == 'e' || *pc == 'E')) {
+		++pc;
+		bool bNegativeExponent = false;
+		if (pc < pcTokenEnd && (*pc == '-' || *pc == '+'))
+			bNegativeExponent = *pc++ == '-';
+		int iExplicitExponent = 0;
+		int iExponentDigits = 0;
+		while (pc < pcTokenEnd && *pc >= '0' && *pc <= '9') {
+			if (iExplicitExponent < 1000)
+				iExplicitExponent = iExplicitExponent * 10 + (*pc - '0');
+			++pc;
+			++iExponentDigits;
+		}
+		if (iExponentDigits == 0)
+			iDigits = 0;
+		iExponent += bNegativeExponent ? -iExplicitExponent : iExplicitExponent;
+	}
+
+	if (iDigits > 0 && pc == pcTokenEnd && bExact &&
+		uiMantissa <= (1u << 24) && iExponent >= -10 && iExponent <= 10) {
+		// both the mantissa and the power of ten are exact floats, so a
+		// single rounded operation gives the correctly rounded value
+		float f = (float)uiMantissa;
+		if (iExponent < 0)
+			f /= s_fvPowersOfTen[-iExponent];
+		else
+			f *= s_fvPowersOfTen[iExponent];
+		fValue = bNegative ? -f : f;
+	}
+	else if (!parseFloatSlow(m_pcPos, pcTokenEnd, fValue)) {
+		fail("a number");
+		return false;
+	}
+
+	m_pcPos = pcTokenEnd;
+	return true;
+}
+
+bool TextScanner::parseFloatSlow(const char* pcBegin, const char* pcEnd, float& fValue)
+{
+	// strtof needs a terminated string; no number we write is this long
+	char szToken[64];
+	size_t iLength = pcEnd - pcBegin;
+	if (iLength == 0 || iLength >= sizeof(szToken))
+		return false;
+	memcpy(szToken, pcBegin, iLength);
+	szToken[iLength] = 0;
+
+	char* pcParsedEnd;
+	fValue = strtof(szToken, &pcParsedEnd);
+	return pcParsedEnd == szToken + iLength;
+}
@@ -0,0 +1,52 @@
+#ifndef TEXTSCANNER_H_INCLUDED
+#define TEXTSCANNER_H_INCLUDED
+
+#pragma warning(disable : 4786)
+
+#include <string>
+#include <vector>
+
+// Reads the whitespace separated numbers of the text .ani and .cam files
+// from a buffer holding the whole file. It accepts what the iostream
+// operators used to, but does not allocate or go through the locale, and
+// the common short floats are converted without calling into the C
+// library.
+//
+// Every read returns false once anything failed; error() then says what
+// was expected and on which line.
+class TextScanner
+{
+public:
+	TextScanner(const char* pcBegin, const char* pcEnd);
+
+	// reads a whole file with a single read; the scanner works on the
+	// buffer, which must outlive it
+	static bool loadFile(const char* szFileName, std::vector<char>& cvBuffer);
+
+	bool readInt(int& iValue);
+	bool readFloat(float& fValue);
+	// 0 or 1, as written by the stream operators
+	bool readBool(bool& bValue);
+
+	bool failed() const { return m_bFailed; }
+	int line() const { return m_iLine; }
+	// the bytes not read yet
+	size_t remaining() const { return m_pcEnd - m_pcPos; }
+	const std::string& error() const { return m_strError; }
+
+	// marks the input as malformed at the current line
+	void fail(const char* szExpected);
+
+protected:
+	const char* m_pcPos;
+	const char* m_pcEnd;
+	int m_iLine;
+	bool m_bFailed;
+	std::string m_strError;
+
+	// skips whitespace and returns the end of the next token
+	const char* nextToken();
+	static bool parseFloatSlow(const char* pcBegin, const char* pcEnd, float& fValue);
+};
+
+#endif // TEXTSCANNER_H_INCLUDED